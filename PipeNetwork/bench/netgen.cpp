@@ -0,0 +1,65 @@
+// Writes a synthetic network in the pipedata.txt format, for scale tests and for
+// reproducing benchmark runs: the same arguments give the same file.
+// usage: netgen grid|geometric|tree|islands nodes file [--seed=N] [--spacing=m]
+//        [--degree=d] [--loops=f] [--islands=k] [--demand=q] [--sources=s] [--dia=min,max]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "../pipenetwork/netgen.h"
+#include "../pipenetwork/netio.h"
+
+using namespace std;
+
+static int usage()
+{
+	printf("usage: netgen grid|geometric|tree|islands nodes file [--seed=N] [--spacing=m]\n"
+		"       [--degree=d] [--loops=f] [--islands=k] [--demand=q] [--sources=s] [--dia=min,max]\n");
+	return 1;
+}
+
+// value of "--name=value" if arg is that option, else NULL
+static const char* option(const char* arg, const char* name)
+{
+	size_t n = strlen(name);
+	if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, n) != 0 || arg[2 + n] != '=') return NULL;
+	return arg + 3 + n;
+}
+
+int main(int argc, char** argv)
+{
+	netgenoptions opt;
+	if (argc < 4 || !parsetopology(argv[1], opt.topology)) return usage();
+	opt.nodes = atoi(argv[2]);
+	const char* path = argv[3];
+	for (int k = 4; k < argc; k++)
+	{
+		const char* v;
+		if ((v = option(argv[k], "seed"))) opt.seed = strtoull(v, NULL, 10);
+		else if ((v = option(argv[k], "spacing"))) opt.spacing = atof(v);
+		else if ((v = option(argv[k], "degree"))) opt.degree = atof(v);
+		else if ((v = option(argv[k], "loops"))) opt.loops = atof(v);
+		else if ((v = option(argv[k], "islands"))) opt.islands = atoi(v);
+		else if ((v = option(argv[k], "demand"))) opt.demand = atof(v);
+		else if ((v = option(argv[k], "sources"))) opt.sources = atoi(v);
+		else if ((v = option(argv[k], "dia")) && sscanf(v, "%lf,%lf", &opt.mindia, &opt.maxdia) == 2) {}
+		else
+		{
+			printf("netgen: unknown option %s\n", argv[k]);
+			return usage();
+		}
+	}
+
+	auto t0 = chrono::steady_clock::now();
+	netdata net;
+	string err;
+	if (!generatenetwork(opt, net, err) || !writenetwork(path, net, err))
+	{
+		printf("%s\n", err.c_str());
+		return 1;
+	}
+	printf("%s: %s, %d nodes, %d tubes, seed %llu, %.3f s\n", path, argv[1], net.n_nodes, net.n_tubes,
+		(unsigned long long)opt.seed, chrono::duration<double>(chrono::steady_clock::now() - t0).count());
+	return 0;
+}
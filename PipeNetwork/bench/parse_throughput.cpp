@@ -0,0 +1,76 @@
+// Throughput of the network loaders: the ifstream constructor (the stream read
+// into memory, then parsed) against readnetwork() from netio.h, on a generated grid network.
+// usage: parse_throughput [nodes per side (default 1000)] [file (default grid.txt)]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "../pipenetwork/classes.h"
+#include "../pipenetwork/netio.h"
+
+using namespace std;
+
+static double seconds(chrono::steady_clock::time_point t0)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char** argv)
+{
+	int side = (argc > 1) ? atoi(argv[1]) : 1000;
+	const char* path = (argc > 2) ? argv[2] : "grid.txt";
+
+	// side x side grid, 100 m spacing, demands balanced by the last node
+	{
+		FILE* f = fopen(path, "w");
+		if (!f)
+		{
+			printf("cannot write %s\n", path);
+			return 1;
+		}
+		int n = side * side;
+		fprintf(f, "%d\n%d\n", n, 2 * side * (side - 1));
+		for (int i = 0; i < n; i++)
+			fprintf(f, "%d %d %g\n", (i % side) * 100, (i / side) * 100, (i == n - 1) ? -(n - 1) * 0.5 : 0.5);
+		for (int i = 0; i < n; i++)
+		{
+			if (i % side + 1 < side) fprintf(f, "%d %d 0.5\n", i + 1, i + 2);
+			if (i / side + 1 < side) fprintf(f, "%d %d 0.5\n", i + 1, i + 1 + side);
+		}
+		fclose(f);
+	}
+	double mb;
+	{
+		mappedfile file(path);
+		mb = file.size() / 1.0e6;
+	}
+	printf("%s: %d nodes, %.1f MB\n", path, side * side, mb);
+
+	auto t0 = chrono::steady_clock::now();
+	{
+		ifstream in(path);
+		pipenet net(in);
+	}
+	double t_stream = seconds(t0);
+
+	netdata data;
+	string err;
+	t0 = chrono::steady_clock::now();
+	if (!readnetwork(path, data, err))
+	{
+		printf("%s\n", err.c_str());
+		return 1;
+	}
+	double t_parse = seconds(t0);
+	t0 = chrono::steady_clock::now();
+	{
+		pipenet net(data);
+	}
+	double t_build = seconds(t0);
+
+	printf("ifstream constructor    %8.3f s  %8.1f MB/s\n", t_stream, mb / t_stream);
+	printf("readnetwork             %8.3f s  %8.1f MB/s\n", t_parse, mb / t_parse);
+	printf("readnetwork + pipenet   %8.3f s  %8.1f MB/s\n", t_parse + t_build, mb / (t_parse + t_build));
+	return 0;
+}
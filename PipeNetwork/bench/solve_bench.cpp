@@ -0,0 +1,259 @@
+// Timings of the solve path phase by phase: parse, assembly, ordering and
+// factorization, direct solve, CG solve, spatial index, and the dense MatVec kernels, on
+// generated grid and tree networks of 10 to 10^6 nodes.
+// usage: solve_bench [--benchmark_filter=...] [--benchmark_out=file.json --benchmark_out_format=json]
+#include <cmath>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "../pipenetwork/classes.h"
+#include "../pipenetwork/MatVec.h"
+#include "../pipenetwork/netio.h"
+#include "../pipenetwork/ordering.h"
+#include "../pipenetwork/spatial.h"
+
+using namespace std;
+
+enum { GRID = 0, TREE = 1 };
+
+// side x side grid of 100 m spacing, or a binary tree laid out 1000 nodes a row.
+// every node draws 0.5, node 1 (the fixed head) supplies them all
+static void makenetwork(int kind, int n, netdata& d)
+{
+	int side = (int)ceil(sqrt((double)n));
+	if (kind == GRID) n = side * side;
+	d.n_nodes = n;
+	d.x.resize(n); d.y.resize(n); d.Q.resize(n);
+	d.n1.clear(); d.n2.clear(); d.dia.clear();
+	for (int i = 0; i < n; i++)
+	{
+		int w = (kind == GRID) ? side : 1000;
+		d.x[i] = (i % w) * 100.0;
+		d.y[i] = (i / w) * 100.0;
+		d.Q[i] = (i == 0) ? -(n - 1) * 0.5 : 0.5;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		if (kind == GRID)
+		{
+			if (i % side + 1 < side) { d.n1.push_back(i); d.n2.push_back(i + 1); }
+			if (i / side + 1 < side) { d.n1.push_back(i); d.n2.push_back(i + side); }
+		}
+		else if (i > 0)
+		{
+			d.n1.push_back((i - 1) / 2);
+			d.n2.push_back(i);
+		}
+	}
+	d.n_tubes = (int)d.n1.size();
+	d.dia.assign(d.n_tubes, 0.5);
+}
+
+// the same network in the text format of pipedata.txt
+static string networktext(const netdata& d)
+{
+	string s = to_string(d.n_nodes) + "\n" + to_string(d.n_tubes) + "\n";
+	char line[96];
+	for (int i = 0; i < d.n_nodes; i++)
+		s.append(line, snprintf(line, sizeof(line), "%g %g %g\n", d.x[i], d.y[i], d.Q[i]));
+	for (int t = 0; t < d.n_tubes; t++)
+		s.append(line, snprintf(line, sizeof(line), "%d %d %g\n", d.n1[t] + 1, d.n2[t] + 1, d.dia[t]));
+	return s;
+}
+
+// networks are generated once per kind and size
+static const netdata& network(int kind, int n)
+{
+	static map<pair<int,int>, netdata> cache;
+	netdata& d = cache[make_pair(kind, n)];
+	if (d.n_nodes == 0) makenetwork(kind, n, d);
+	return d;
+}
+
+static void label(benchmark::State& state, const netdata& d)
+{
+	state.SetLabel(string(state.range(0) == GRID ? "grid" : "tree") + " " + to_string(d.n_nodes) + " nodes");
+	state.counters["nodes"] = d.n_nodes;
+	state.counters["tubes"] = d.n_tubes;
+}
+
+static void BM_Parse(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	string text = networktext(d);
+	for (auto _ : state)
+	{
+		netdata out;
+		string err;
+		bool ok = parsenetwork(text.data(), text.data() + text.size(), "bench", out, err);
+		benchmark::DoNotOptimize(ok);
+	}
+	state.SetBytesProcessed(state.iterations() * (int64_t)text.size());
+	label(state, d);
+}
+
+static void BM_Assemble(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	pipenet net(d);
+	for (auto _ : state)
+	{
+		SparseMtx A = net.assemble();
+		benchmark::DoNotOptimize(A.nnz());
+	}
+	label(state, d);
+}
+
+static void BM_Order(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	pipenet net(d);
+	SparseMtx A = net.assemble();
+	vector<int> perm(A.size());
+	for (auto _ : state)
+	{
+		amdorder(A, perm.data());
+		benchmark::DoNotOptimize(perm.data());
+	}
+	label(state, d);
+}
+
+static void BM_Factorize(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	pipenet net(d);
+	SparseMtx A = net.assemble();
+	vector<int> perm(A.size());
+	amdorder(A, perm.data());
+	int nnz = 0;
+	for (auto _ : state)
+	{
+		SparseLDL L(A, perm.data());
+		nnz = L.nnz();
+	}
+	label(state, d);
+	state.counters["nnz(L)"] = nnz;
+}
+
+static void BM_DirectSolve(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	pipenet net(d);
+	net.factorize();
+	for (auto _ : state)
+		net.solve(); //triangular solves, residual and tube flows
+	label(state, d);
+}
+
+static void BM_CGSolve(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	int iterations = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		pipenet net(d); //cold start every time
+		state.ResumeTiming();
+		net.solve();
+		iterations = net.getiterations();
+	}
+	label(state, d);
+	state.counters["CG iterations"] = iterations;
+}
+
+static void BM_AMGSolve(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	int iterations = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		pipenet net(d);
+		net.setsolver(3, 1e-10, 0); //multigrid setup is timed with the solve
+		state.ResumeTiming();
+		net.solve();
+		iterations = net.getiterations();
+	}
+	label(state, d);
+	state.counters["CG iterations"] = iterations;
+}
+
+static void BM_SpatialBuild(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	for (auto _ : state)
+	{
+		spatialindex index(d);
+		benchmark::DoNotOptimize(index.nodes());
+	}
+	label(state, d);
+}
+
+// nearest node to points spread over the network, then the nodes of a 1 km box around them
+static void BM_SpatialQuery(benchmark::State& state)
+{
+	const netdata& d = network((int)state.range(0), (int)state.range(1));
+	spatialindex index(d);
+	vector<int> found;
+	int k = 0;
+	for (auto _ : state)
+	{
+		int i = (int)((k++ * 2654435761u) % (unsigned)d.n_nodes);
+		double x = d.x[i] + 37.0, y = d.y[i] + 53.0;
+		int nearest;
+		index.nearestnodes(x, y, 1, &nearest);
+		found.clear();
+		index.nodesinbox(x - 500.0, y - 500.0, x + 500.0, y + 500.0, found);
+		benchmark::DoNotOptimize(nearest);
+	}
+	label(state, d);
+}
+
+static void BM_Dot(benchmark::State& state)
+{
+	Vcr a((int)state.range(0), 1.0), b((int)state.range(0), 2.0);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(dot(a, b));
+	state.SetBytesProcessed(state.iterations() * state.range(0) * 2 * (int64_t)sizeof(double));
+}
+
+static void BM_Twonorm(benchmark::State& state)
+{
+	Vcr a((int)state.range(0), 1.0);
+	for (auto _ : state)
+		benchmark::DoNotOptimize(a.twonorm());
+	state.SetBytesProcessed(state.iterations() * state.range(0) * (int64_t)sizeof(double));
+}
+
+static void BM_GaussElim(benchmark::State& state)
+{
+	const int n = (int)state.range(0);
+	Mtx A(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			A[i][j] = (i == j) ? n : 1.0 / (1 + i + j);
+	for (auto _ : state)
+	{
+		Vcr b(n, 1.0);
+		A.GaussElim(b);
+		benchmark::DoNotOptimize(b[0]);
+	}
+}
+
+#define NETWORK_SIZES ArgsProduct({{GRID, TREE}, {10, 100, 1000, 10000, 100000, 1000000}})
+BENCHMARK(BM_Parse)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Assemble)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Order)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Factorize)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DirectSolve)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CGSolve)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AMGSolve)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SpatialBuild)->NETWORK_SIZES->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SpatialQuery)->NETWORK_SIZES;
+BENCHMARK(BM_Dot)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_Twonorm)->RangeMultiplier(10)->Range(1000, 1000000);
+BENCHMARK(BM_GaussElim)->RangeMultiplier(10)->Range(10, 1000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -4,15 +4,21 @@
 */
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
 #include <iostream> 
+#include <new>
+#include <utility>
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
 #include "MatVec.h"
+#include "threadpool.h"
 
 using namespace std;
 
-// report error and exit with return value 1.
+// report an error to the caller
 void error(const char* t) {
-  std::cout << t << ". program exited." << "\n";
-  exit(1);
+  throw MatVecError(t);
 }
 // returns the max of two doubles
 // an inline function must be defined in every file in which
@@ -22,21 +28,114 @@ inline double max(double a, double b)
 	return (a < b) ?  b : a;
 }
 
+//---------------------------------------------------------------------------------
+// dense kernels on contiguous rows, AVX2 for double when the compiler targets it
+// (-mavx2 -mfma), plain loops otherwise and for float
+//---------------------------------------------------------------------------------
+const int MTX_ALIGN = 64;							// byte alignment of Mtx storage
+const int MTX_LANES = 4;							// doubles per AVX2 register
+const int MTX_NB = 64;								// panel width of the blocked LU
+const int MTX_JB = 512;								// column tile of trailing updates
+
+// y[0..n) += a*x[0..n)
+template<class T> static inline void axpy(T* y, const T* x, T a, int n)
+{
+  for (int j = 0; j < n; j++) y[j] += a*x[j];
+}
+// sum of x[j]*y[j], j in [0,n)
+template<class T> static inline T dotk(const T* x, const T* y, int n)
+{
+  T s = 0;
+  for (int j = 0; j < n; j++) s += x[j]*y[j];
+  return s;
+}
+// sum of |x[j]|, j in [0,n)
+template<class T> static inline double sumabs(const T* x, int n)
+{
+  double s = 0.0;
+  for (int j = 0; j < n; j++) s += fabs(x[j]);
+  return s;
+}
+// acc[j] += |x[j]|, j in [0,n)
+template<class T> static inline void addabs(double* acc, const T* x, int n)
+{
+  for (int j = 0; j < n; j++) acc[j] += fabs(x[j]);
+}
+#if defined(__AVX2__) && defined(__FMA__)
+// the same four for double, two registers at a time
+static inline void axpy(double* y, const double* x, double a, int n)
+{
+  int j = 0;
+  __m256d va = _mm256_set1_pd(a);
+  for (; j + 8 <= n; j += 8) {
+    __m256d y0 = _mm256_loadu_pd(y + j), y1 = _mm256_loadu_pd(y + j + 4);
+    y0 = _mm256_fmadd_pd(va, _mm256_loadu_pd(x + j), y0);
+    y1 = _mm256_fmadd_pd(va, _mm256_loadu_pd(x + j + 4), y1);
+    _mm256_storeu_pd(y + j, y0);
+    _mm256_storeu_pd(y + j + 4, y1);
+  }
+  for (; j < n; j++) y[j] += a*x[j];
+}
+static inline double dotk(const double* x, const double* y, int n)
+{
+  int j = 0;
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  for (; j + 8 <= n; j += 8) {
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j), _mm256_loadu_pd(y + j), s0);
+    s1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + j + 4), _mm256_loadu_pd(y + j + 4), s1);
+  }
+  double t[MTX_LANES];
+  _mm256_storeu_pd(t, _mm256_add_pd(s0, s1));
+  double s = (t[0] + t[1]) + (t[2] + t[3]);
+  for (; j < n; j++) s += x[j]*y[j];
+  return s;
+}
+static inline double sumabs(const double* x, int n)
+{
+  int j = 0;
+  const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  for (; j + 8 <= n; j += 8) {
+    s0 = _mm256_add_pd(s0, _mm256_and_pd(mask, _mm256_loadu_pd(x + j)));
+    s1 = _mm256_add_pd(s1, _mm256_and_pd(mask, _mm256_loadu_pd(x + j + 4)));
+  }
+  double t[MTX_LANES];
+  _mm256_storeu_pd(t, _mm256_add_pd(s0, s1));
+  double s = (t[0] + t[1]) + (t[2] + t[3]);
+  for (; j < n; j++) s += fabs(x[j]);
+  return s;
+}
+static inline void addabs(double* acc, const double* x, int n)
+{
+  int j = 0;
+  const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+  for (; j + 4 <= n; j += 4)
+    _mm256_storeu_pd(acc + j, _mm256_add_pd(_mm256_loadu_pd(acc + j),
+                                            _mm256_and_pd(mask, _mm256_loadu_pd(x + j))));
+  for (; j < n; j++) acc[j] += fabs(x[j]);
+}
+#endif
+
 //---------------------------------------------------------------------------------
 // members of class Vcr
 //---------------------------------------------------------------------------------
 // constructor
-Vcr::Vcr(int n, double* a) {
-  vr = new double [lenth = n]; 
+template<class T> Vector<T>::Vector(int n, const T* a) {
+  vr = new T [lenth = n]; 
   for (int i = 0; i < lenth; i++)  vr[i] = a[i];
 }
+// constructor, all entries = t
+template<class T> Vector<T>::Vector(int n, T t) {
+  vr = new T [lenth = n]; 
+  for (int i = 0; i < lenth; i++)  vr[i] = t;
+}
 // copy constructor
-Vcr::Vcr(const Vcr& vec) {
-  vr = new double [lenth = vec.lenth]; 
+template<class T> Vector<T>::Vector(const Vector& vec) {
+  vr = new T [lenth = vec.lenth]; 
   for (int i = 0; i < lenth; i++)  vr[i] = vec.vr[i]; 
 }
 // copy assignment
-Vcr& Vcr::operator=(const Vcr& vec) {
+template<class T> Vector<T>& Vector<T>::operator=(const Vector& vec) {
   if (this != &vec) {
     if (lenth != vec.lenth) error("bad vector sizes in Vcr::operator=()");
     for (int i = 0; i < lenth; i++) vr[i] = vec.vr[i];
@@ -44,159 +143,769 @@ Vcr& Vcr::operator=(const Vcr& vec) {
   return *this;
 }
 // one norm
-double Vcr::onenorm() const
+template<class T> double Vector<T>::onenorm() const
 {
-	double norm = fabs(vr[0]);
-	for (int i = 1; i < lenth; i++) norm += fabs(vr[i]);
-	return norm;
+	return ::onenorm(*this);
 }
 // two norm
-double Vcr::twonorm() const
+template<class T> double Vector<T>::twonorm() const
 {
-	double norm = vr[0]*vr[0];
-	for (int i= 1; i < lenth; i++) norm += vr[i] * vr[i];
-	return sqrt(norm);
+	return ::twonorm(*this);
 }
 // maximum norm
-double Vcr::maxnorm() const
+template<class T> double Vector<T>::maxnorm() const
 {
-	double norm = fabs(vr[0]);
-	for (int i = 1; i < lenth; i++) norm = max(norm, fabs(vr[i]));
-	return norm;
+	return ::maxnorm(*this);
 }
 // print vector
-void Vcr::print() const
+template<class T> void Vector<T>::print() const
 {
 	for (int i=0;i<lenth;++i)
 	{
-		cout << vr[i] << endl;
+		cout << vr[i] << "\n";
 	}
+	cout.flush();
 }
 
-double Vcr::getvalues(int n)
+template<class T> T Vector<T>::getvalues(int n)
 {
 	return vr[n];
 }
 
-// a friend
-double dot(const Vcr & v1, const Vcr & v2) {
-  if (v1.lenth != v2.lenth ) error("bad vector sizes in dot product");
-  double tm = v1[0]*v2[0];
-  for (int i = 1; i < v1.lenth; i++) tm += v1[i]*v2[i];
-  return tm;
-}
-
 //---------------------------------------------------------------------------------
 // members of class Mtx
 //---------------------------------------------------------------------------------
+// allocates an aligned buffer for n rows of stride ld
+template<class T> static T* mtxalloc(int n, int ld)
+{
+  size_t bytes = sizeof(T)*(size_t)n*(size_t)ld;
+  if (bytes == 0) bytes = MTX_ALIGN;
+  return static_cast<T*>(::operator new[](bytes, std::align_val_t(MTX_ALIGN)));
+}
+// row stride of an n x n matrix, rows start on a 32 byte boundary
+template<class T> static inline int mtxstride(int n)
+{
+  const int lanes = 32/sizeof(T);
+  return (n + lanes - 1)/lanes*lanes;
+}
+
 // constructor
-Mtx::Mtx(int n, double** a) {
+template<class T> Matrix<T>::Matrix(int n, T** a) {
+  dimn = n;
+  ld = mtxstride<T>(n);
+  mx = mtxalloc<T>(dimn, ld);
+  for (int i =  0; i< dimn; i++) 
+  {
+    T* row = (*this)[i];
+    for (int j = 0; j < dimn; j++) row[j] = a[i][j];
+    for (int j = dimn; j < ld; j++) row[j] = 0;
+  }
+}
+// constructor, all entries = t
+template<class T> Matrix<T>::Matrix(int n, T t) {
   dimn = n;
-  mx = new double* [dimn]; 
+  ld = mtxstride<T>(n);
+  mx = mtxalloc<T>(dimn, ld);
   for (int i =  0; i< dimn; i++) 
   {
-    mx[i] = new double [dimn];
-    for (int j = 0; j < dimn; j++) mx[i][j] = a[i][j];
+    T* row = (*this)[i];
+    for (int j = 0; j < dimn; j++) row[j] = t;
+    for (int j = dimn; j < ld; j++) row[j] = 0;
   }
 }
 // copy constructor
-Mtx::Mtx(const Mtx& M)                             
+template<class T> Matrix<T>::Matrix(const Matrix& M)                             
 {
   dimn = M.dimn;
-  mx = new double* [dimn]; 
-  for (int i =  0; i < dimn; i++) 
-  {
-    mx[i] = new double [dimn];
-    for (int j = 0; j < dimn; j++) mx[i][j] = M.mx[i][j];
-  }
-
+  ld = M.ld;
+  mx = mtxalloc<T>(dimn, ld);
+  memcpy(mx, M.mx, sizeof(T)*(size_t)dimn*(size_t)ld);
 }
 // copy assignment  
-Mtx& Mtx::operator=(const Mtx& M)
+template<class T> Matrix<T>& Matrix<T>::operator=(const Matrix& M)
 {
   if (dimn!=M.dimn) error("Matrices have different size in =");
-  for (int i =  0; i < dimn; i++) 
-  {
-    for (int j = 0; j < dimn; j++) mx[i][j] = M.mx[i][j];
-
-  }
+  if (this != &M) memcpy(mx, M.mx, sizeof(T)*(size_t)dimn*(size_t)ld);
   return *this;
 }
+// destructor
+template<class T> Matrix<T>::~Matrix()
+{
+  ::operator delete[](mx, std::align_val_t(MTX_ALIGN));
+}
 // print matrix
-void Mtx::print() const
+template<class T> void Matrix<T>::print() const
 {
 	for (int i=0; i<dimn; i++)
     {
-		for (int j=0;j<dimn;j++) cout << mx[i][j] << "\t"; 
-	    cout << endl;
+		for (int j=0;j<dimn;j++) cout << (*this)[i][j] << "\t"; 
+	    cout << "\n";
 	}
+	cout.flush();
 }
 // one norm
-double Mtx::onenorm() const
+template<class T> double Matrix<T>::onenorm() const
 {
 	double norm = 0.0;
+	double* temp = new double [MTX_JB];	// store column abs sums of one column tile
 
-	for (int j = 0; j < dimn; j++)
+	for (int jb = 0; jb < dimn; jb += MTX_JB)
 	{
-		double temp = 0.0;	// store column abs sum
-		for (int i = 0; i < dimn; i++) temp += fabs(mx[i][j]);
-		norm = max(norm, temp);	
+		int nj = (dimn - jb < MTX_JB) ? dimn - jb : MTX_JB;
+		for (int j = 0; j < nj; j++) temp[j] = 0.0;
+		for (int i = 0; i < dimn; i++) addabs(temp, (*this)[i] + jb, nj);
+		for (int j = 0; j < nj; j++) norm = max(norm, temp[j]);
 	}
+	delete[] temp;
 	return norm;
 }
 // maximum norm
-double Mtx::maxnorm() const
+template<class T> double Matrix<T>::maxnorm() const
 {
 	double norm = 0.0;
 
 	for (int i = 0; i < dimn; i++)
-	{
-		double temp = 0.0;	// store column abs sum
-		for (int j = 0; j < dimn; j++) temp += fabs(mx[i][j]);
-		norm = max(norm, temp);	
-	}
+		norm = max(norm, sumabs((*this)[i], dimn));	// row abs sum
 	return norm;
 }
 // Frobenius norm
-double Mtx::frobnorm() const
+template<class T> double Matrix<T>::frobnorm() const
 {
 	double norm = 0.0;
 
 	for (int i = 0; i < dimn; i++)
-		for (int j = 0; j < dimn; j++)	norm += mx[i][j] * mx[i][j];
+		norm += dotk((*this)[i], (*this)[i], dimn);
 	
 	return sqrt(norm);
 }
-// Gaussian elimination A x = bb
-void Mtx::GaussElim(Vcr& bb) const
+// Gaussian elimination A x = bb, the factors go in a copy of A
+template<class T> void Matrix<T>::GaussElim(Vector<T>& bb) const &
+{
+  Matrix<T> tmpx(*this);
+  static_cast<Matrix<T>&&>(tmpx).GaussElim(bb);
+} // end GaussElim()
+// Gaussian elimination A x = bb, the factors overwrite A
+template<class T> void Matrix<T>::GaussElim(Vector<T>& bb) &&
 {
   if (dimn != bb.size() ) 
     error("matrix or vector sizes do not match");
-  Mtx tmpx = *this;
-  
-  // LU decomposition without pivoting 
-  for (int k = 0; k < dimn - 1; k++) {
-    if (tmpx[k][k] == 0) 
-      error("pivot is zero in Mtx::GaussElim()");
-    for (int i = k + 1; i < dimn; i++) {
-      if (tmpx[i][k] != 0)
-	  {   // tmpx[i][k] can be complex
-        double mult = tmpx[i][k]/tmpx[k][k];
-        tmpx[i][k] = mult;
-        for (int j = k + 1; j < dimn; j++) 
-          tmpx[i][j] -= mult*tmpx[k][j];
+  LUMatrix<T> tmpx(std::move(*this));
+  if (tmpx.info() != 0)
+    error("matrix is singular in Mtx::GaussElim()");
+  tmpx.solve(bb);
+} // end GaussElim()
+
+//---------------------------------------------------------------------------------
+// members of class LUMtx
+//---------------------------------------------------------------------------------
+template<class T> LUMatrix<T>::LUMatrix(const Matrix<T>& A) : lu(A)
+{
+  factor();
+}
+template<class T> LUMatrix<T>::LUMatrix(Matrix<T>&& A) : lu(std::move(A))
+{
+  factor();
+}
+// right-looking blocked LU decomposition with partial pivoting. each panel of
+// MTX_NB columns is factored, then the block row of U and the trailing matrix
+// are updated tile by tile, with the tiles spread over the shared thread pool
+template<class T> void LUMatrix<T>::factor()
+{
+  const int n = lu.size();
+  const int ROWS = 4*MTX_NB;						// row tile of parallel updates
+  threadpool& pool = threadpool::shared();
+  piv = new int [n];
+  singular = 0;
+  for (int k = 0; k < n; k++) piv[k] = k;
+
+  for (int kb = 0; kb < n; kb += MTX_NB) {
+    int ke = (n - kb < MTX_NB) ? n : kb + MTX_NB;
+
+    // factor the panel: columns kb..ke-1, all rows below the diagonal
+    for (int k = kb; k < ke; k++) {
+      int p = k;									// pivot: largest entry in column k
+      for (int i = k + 1; i < n; i++)
+        if (fabs(lu[i][k]) > fabs(lu[p][k])) p = i;
+      if (lu[p][k] == 0) {
+        singular = k + 1;
+        return;
+      }
+      piv[k] = p;
+      if (p != k) {									// whole rows, L part included
+        T* rk = lu[k];
+        T* rp = lu[p];
+        for (int j = 0; j < n; j++) { T t = rk[j]; rk[j] = rp[j]; rp[j] = t; }
       }
+      const T* rowk = lu[k];
+      const T pivot = rowk[k];
+      const int nrows = n - k - 1;
+      pool.parallel_for((nrows + ROWS - 1)/ROWS, [&](int t) {
+        int ie = k + 1 + (t + 1)*ROWS;
+        if (ie > n) ie = n;
+        for (int i = k + 1 + t*ROWS; i < ie; i++) {
+          T* rowi = lu[i];
+          if (rowi[k] != 0) {
+            T mult = rowi[k]/pivot;
+            rowi[k] = mult;
+            axpy(rowi + k + 1, rowk + k + 1, -mult, ke - k - 1);
+          }
+        }
+      });
     }
+    if (ke == n) break;
+
+    // block row of U: rows kb..ke-1, columns ke..n-1, unit lower solve,
+    // independent per column tile
+    const int ntj = (n - ke + MTX_JB - 1)/MTX_JB;
+    pool.parallel_for(ntj, [&](int t) {
+      int jb = ke + t*MTX_JB;
+      int nj = (n - jb < MTX_JB) ? n - jb : MTX_JB;
+      for (int k = kb; k < ke; k++)
+        for (int i = k + 1; i < ke; i++)
+          if (lu[i][k] != 0) axpy(lu[i] + jb, lu[k] + jb, -lu[i][k], nj);
+    });
+
+    // trailing matrix A22 -= L21 U12 over a grid of row x column tiles
+    const int nti = (n - ke + ROWS - 1)/ROWS;
+    pool.parallel_for(nti*ntj, [&](int t) {
+      int ib = ke + (t/ntj)*ROWS;
+      int ie = (n - ib < ROWS) ? n : ib + ROWS;
+      int jb = ke + (t%ntj)*MTX_JB;
+      int nj = (n - jb < MTX_JB) ? n - jb : MTX_JB;
+      for (int i = ib; i < ie; i++) {
+        T* rowi = lu[i];
+        for (int k = kb; k < ke; k++)
+          if (rowi[k] != 0) axpy(rowi + jb, lu[k] + jb, -rowi[k], nj);
+      }
+    });
   }
+}
+// copy constructor
+template<class T> LUMatrix<T>::LUMatrix(const LUMatrix& F) : lu(F.lu)
+{
+  const int n = lu.size();
+  piv = new int [n];
+  for (int k = 0; k < n; k++) piv[k] = F.piv[k];
+  singular = F.singular;
+}
+// solves A x = bb with the stored factors, x stored in bb
+template<class T> void LUMatrix<T>::solve(Vector<T>& bb) const
+{
+  const int n = lu.size();
+  if (n != bb.size()) error("matrix or vector sizes do not match");
+  if (singular != 0) error("solve with singular factors in LUMtx::solve()");
+  T* b = &bb[0];
+
+  // row interchanges in the order they were made
+  for (int k = 0; k < n; k++)
+    if (piv[k] != k) { T t = b[k]; b[k] = b[piv[k]]; b[piv[k]] = t; }
 
   // forwad substitution for L y = b. y still stored in bb
-  for (int i = 1; i < dimn; i++) 
-    for (int j = 0; j < i; j++) bb[i] -= tmpx[i][j]*bb[j];
+  for (int i = 1; i < n; i++) b[i] -= dotk(lu[i], b, i);
 
   // back substitution for U x = y. x still stored in bb
-  for (int i = dimn - 1; i >= 0; i--) {
-    for (int j=i+1; j<dimn; j++) bb[i] -= tmpx[i][j]*bb[j];
-    bb[i] /= tmpx[i][i];
+  for (int i = n - 1; i >= 0; i--) {
+    b[i] -= dotk(lu[i] + i + 1, b + i + 1, n - i - 1);
+    b[i] /= lu[i][i];
   }
-} // end GaussElim()
+}
+
+// the scalar types the templates are built for
+template class Vector<float>;
+template class Vector<double>;
+template class Matrix<float>;
+template class Matrix<double>;
+template class LUMatrix<float>;
+template class LUMatrix<double>;
+
+//---------------------------------------------------------------------------------
+// members of class SparseMtx
+//---------------------------------------------------------------------------------
+// constructor, t holds the entries, c their columns and f the row starts
+SparseMtx::SparseMtx(int n, int m, double* t, int* c, int* f) {
+  nrows = n;
+  lenth = m;
+  sra = new double [lenth];
+  clm = new int [lenth];
+  fnz = new int [nrows + 1];
+  for (int i = 0; i < lenth; i++) { sra[i] = t[i]; clm[i] = c[i]; }
+  for (int i = 0; i <= nrows; i++) fnz[i] = f[i];
+}
+// assembly from triplets: entry a[k] is added at row ia[k], column ja[k].
+// memory is proportional to m, the dense n x n matrix is never formed
+SparseMtx::SparseMtx(int n, int m, const int* ia, const int* ja, const double* a) {
+  nrows = n;
+  fnz = new int [nrows + 1];
+  for (int i = 0; i <= nrows; i++) fnz[i] = 0;
+  for (int k = 0; k < m; k++) {
+    if (ia[k] < 0 || ia[k] >= nrows || ja[k] < 0 || ja[k] >= nrows)
+      error("triplet index out of range in SparseMtx()");
+    fnz[ia[k] + 1]++;
+  }
+  for (int i = 0; i < nrows; i++) fnz[i + 1] += fnz[i];
+
+  // scatter the triplets into their rows
+  int* next = new int [nrows];
+  for (int i = 0; i < nrows; i++) next[i] = fnz[i];
+  clm = new int [m];
+  sra = new double [m];
+  for (int k = 0; k < m; k++) {
+    int p = next[ia[k]]++;
+    clm[p] = ja[k];
+    sra[p] = a[k];
+  }
+  delete[] next;
+
+  // sort each row by column and sum duplicates, compacting in place
+  lenth = 0;
+  for (int i = 0; i < nrows; i++) {
+    int start = fnz[i], end = fnz[i + 1];
+    for (int p = start + 1; p < end; p++) {		// rows are short: insertion sort
+      int c = clm[p];
+      double v = sra[p];
+      int q = p - 1;
+      for (; q >= start && clm[q] > c; q--) { clm[q + 1] = clm[q]; sra[q + 1] = sra[q]; }
+      clm[q + 1] = c;
+      sra[q + 1] = v;
+    }
+    fnz[i] = lenth;
+    for (int p = start; p < end; p++) {
+      if (lenth > fnz[i] && clm[lenth - 1] == clm[p]) sra[lenth - 1] += sra[p];
+      else { clm[lenth] = clm[p]; sra[lenth] = sra[p]; lenth++; }
+    }
+  }
+  fnz[nrows] = lenth;
+}
+// copy constructor
+SparseMtx::SparseMtx(const SparseMtx& S) {
+  nrows = S.nrows;
+  lenth = S.lenth;
+  sra = new double [lenth];
+  clm = new int [lenth];
+  fnz = new int [nrows + 1];
+  for (int i = 0; i < lenth; i++) { sra[i] = S.sra[i]; clm[i] = S.clm[i]; }
+  for (int i = 0; i <= nrows; i++) fnz[i] = S.fnz[i];
+}
+// move constructor, S is left empty
+SparseMtx::SparseMtx(SparseMtx&& S) noexcept
+  : nrows(S.nrows), lenth(S.lenth), sra(S.sra), clm(S.clm), fnz(S.fnz) {
+  S.nrows = S.lenth = 0;
+  S.sra = 0; S.clm = 0; S.fnz = 0;
+}
+// move assignment, the storage is exchanged
+SparseMtx& SparseMtx::operator=(SparseMtx&& S) noexcept {
+  swap(nrows, S.nrows); swap(lenth, S.lenth);
+  swap(sra, S.sra); swap(clm, S.clm); swap(fnz, S.fnz);
+  return *this;
+}
+// copy assignment
+SparseMtx& SparseMtx::operator=(const SparseMtx& S) {
+  if (this != &S) {
+    if (nrows != S.nrows || lenth != S.lenth)
+      error("bad matrix sizes in SparseMtx::operator=()");
+    for (int i = 0; i < lenth; i++) { sra[i] = S.sra[i]; clm[i] = S.clm[i]; }
+    for (int i = 0; i <= nrows; i++) fnz[i] = S.fnz[i];
+  }
+  return *this;
+}
+// entry at row i and column j, zero if it is not stored
+double SparseMtx::operator()(int i, int j) const {
+  int p = find(i, j);
+  return (p < 0) ? 0.0 : sra[p];
+}
+// position in sra of entry (i,j), -1 if it is not stored. columns are
+// searched by bisection, so they must be sorted within the row
+int SparseMtx::find(int i, int j) const {
+  int lo = fnz[i], hi = fnz[i + 1];
+  while (lo < hi) {
+    int mid = (lo + hi)/2;
+    if (clm[mid] < j) lo = mid + 1;
+    else hi = mid;
+  }
+  return (lo < fnz[i + 1] && clm[lo] == j) ? lo : -1;
+}
+// matrix vector multiply
+Vcr SparseMtx::operator*(const Vcr& vec) const {
+  if (nrows != vec.size()) error("matrix and vector sizes do not match");
+  Vcr tm(nrows);
+  for (int i = 0; i < nrows; i++) {
+    double sum = 0.0;
+    for (int p = fnz[i]; p < fnz[i + 1]; p++) sum += sra[p]*vec[clm[p]];
+    tm[i] = sum;
+  }
+  return tm;
+}
+// one norm: largest sum of absolute values down a column
+double SparseMtx::onenorm() const
+{
+  Vcr colsum(nrows);
+  for (int p = 0; p < lenth; p++) colsum[clm[p]] += fabs(sra[p]);
+  return colsum.maxnorm();
+}
+// print stored entries as (row, column) value
+void SparseMtx::print() const
+{
+	for (int i = 0; i < nrows; i++)
+		for (int p = fnz[i]; p < fnz[i + 1]; p++)
+			cout << "(" << i << ", " << clm[p] << ")\t" << sra[p] << "\n";
+}
+// incomplete Cholesky IC(0) of the SPD matrix (sra, clm, fnz): L L^T ~ A where
+// L keeps the pattern of the lower triangle of A. columns must be sorted within
+// each row. a pivot that breaks down is replaced by the diagonal entry of A
+static void icfactor(int n, const double* sra, const int* clm, const int* fnz,
+                     double*& lsra, int*& lclm, int*& lfnz)
+{
+  lfnz = new int [n + 1];
+  lfnz[0] = 0;
+  for (int i = 0; i < n; i++) {
+    int cnt = 0;
+    for (int p = fnz[i]; p < fnz[i + 1]; p++) if (clm[p] <= i) cnt++;
+    lfnz[i + 1] = lfnz[i] + cnt;
+  }
+  lsra = new double [lfnz[n]];
+  lclm = new int [lfnz[n]];
 
+  for (int i = 0; i < n; i++) {
+    int q = lfnz[i];
+    double aii = 0.0;
+    for (int p = fnz[i]; p < fnz[i + 1]; p++) {
+      if (clm[p] < i) { lclm[q] = clm[p]; lsra[q] = sra[p]; q++; }
+      else if (clm[p] == i) aii = sra[p];
+    }
+    // L(i,k) = (A(i,k) - sum_{j<k} L(i,j) L(k,j)) / L(k,k)
+    for (int p = lfnz[i]; p < q; p++) {
+      int k = lclm[p];
+      double s = lsra[p];
+      int pi = lfnz[i], pk = lfnz[k], endk = lfnz[k + 1] - 1;	// last entry of row k is L(k,k)
+      while (pi < p && pk < endk) {
+        if (lclm[pi] == lclm[pk]) s -= lsra[pi++]*lsra[pk++];
+        else if (lclm[pi] < lclm[pk]) pi++;
+        else pk++;
+      }
+      lsra[p] = s/lsra[endk];
+    }
+    double d = aii;
+    for (int p = lfnz[i]; p < q; p++) d -= lsra[p]*lsra[p];
+    if (d <= 0.0) d = aii;
+    if (d <= 0.0) error("matrix is not positive definite in icfactor()");
+    lclm[q] = i;
+    lsra[q] = sqrt(d);
+  }
+}
+// solves L L^T z = r with the factor from icfactor()
+static void icsolve(int n, const double* lsra, const int* lclm, const int* lfnz,
+                    const Vcr& r, Vcr& z)
+{
+  for (int i = 0; i < n; i++) {						// forward substitution L y = r
+    double s = r[i];
+    int last = lfnz[i + 1] - 1;
+    for (int p = lfnz[i]; p < last; p++) s -= lsra[p]*z[lclm[p]];
+    z[i] = s/lsra[last];
+  }
+  for (int i = n - 1; i >= 0; i--) {				// back substitution L^T z = y
+    int last = lfnz[i + 1] - 1;
+    z[i] /= lsra[last];
+    for (int p = lfnz[i]; p < last; p++) z[lclm[p]] -= lsra[p]*z[i];
+  }
+}
+
+// diagonal scaling, z = D^-1 r
+class jacobiprecond : public Preconditioner {
+  Vcr diag;
+public:
+  jacobiprecond(const SparseMtx& A) : diag(A.size()) {
+    for (int i = 0; i < A.size(); i++) {
+      diag[i] = A(i, i);
+      if (diag[i] == 0.0) error("zero diagonal entry in Jacobi preconditioner");
+    }
+  }
+  void apply(const Vcr& r, Vcr& z) const {
+    for (int i = 0; i < r.size(); i++) z[i] = r[i]/diag[i];
+  }
+};
+// incomplete Cholesky, z = (L L^T)^-1 r
+class icprecond : public Preconditioner {
+  int n;
+  double* lsra;
+  int* lclm;
+  int* lfnz;
+public:
+  icprecond(const SparseMtx& A) : n(A.size()) {
+    icfactor(n, A.getsra(), A.getclm(), A.getfnz(), lsra, lclm, lfnz);
+  }
+  icprecond(const icprecond&) = delete;
+  ~icprecond() { delete[] lsra; delete[] lclm; delete[] lfnz; }
+  void apply(const Vcr& r, Vcr& z) const { icsolve(n, lsra, lclm, lfnz, r, z); }
+};
+
+// preconditioned conjugate gradient method for a symmetric positive definite A x = b
+// x:    on entry: initial guess; on return: approximate solution
+// b:    right side vector
+// eps:  on entry: stopping criterion, relative to the two norm of b;
+//       on return: two norm of the final residual relative to b
+// iter: on entry: max number of iterations allowed;
+//       on return: actual number of iterations taken
+// M:    the preconditioner, 0 for none
+// it returns 0 for a successful return and 1 for no convergence or breakdown
+static int pcg(const SparseMtx& A, Vcr& x, const Vcr& b, double& eps, int& iter,
+               const Preconditioner* M)
+{
+  const int nrows = A.size();
+  const int* fnz = A.getfnz();
+  const int* clm = A.getclm();
+  const double* sra = A.getsra();
+  if (nrows != b.size() || nrows != x.size())
+    error("matrix and vector sizes do not match in CG()");
+  const int maxiter = iter;
+  const double bnorm = b.twonorm();
+  if (bnorm == 0.0) {								// trivial solution
+    for (int i = 0; i < nrows; i++) x[i] = 0.0;
+    eps = 0.0; iter = 0;
+    return 0;
+  }
+  const double stop = eps*bnorm;
+
+  Vcr r = A*x;										// residual r = b - A x
+  r = b - r;
+  Vcr zp(M ? nrows : 0);							// preconditioned residual,
+  const Vcr& z = M ? zp : r;						// r itself without preconditioner
+  Vcr ap(nrows);
+  if (M) M->apply(r, zp);
+  Vcr p = z;										// search direction
+  double rz = dot(r, z);
+  double rr = dot(r, r);
+
+  for (iter = 0; iter < maxiter; iter++) {
+    if (sqrt(rr) <= stop) break;
+    for (int i = 0; i < nrows; i++) {				// ap = A p
+      double sum = 0.0;
+      for (int k = fnz[i]; k < fnz[i + 1]; k++) sum += sra[k]*p[clm[k]];
+      ap[i] = sum;
+    }
+    double pap = dot(p, ap);
+    if (pap <= 0.0) break;							// A is not positive definite
+    double alpha = rz/pap;
+    x += alpha*p;
+    r -= alpha*ap;
+    if (M) M->apply(r, zp);
+    double rznew = dot(r, z);
+    double beta = rznew/rz;
+    rz = rznew;
+    rr = dot(r, r);
+    p = z + beta*p;
+  }
+  eps = sqrt(rr)/bnorm;
+  return (sqrt(rr) <= stop) ? 0 : 1;
+} // end pcg()
+
+// pn:   =0 if no preconditioner, =1 if Jacobi (diagonal) precr,
+//       =2 if incomplete Cholesky IC(0) precr, set up for this solve
+int SparseMtx::CG(Vcr& x, const Vcr& b, double& eps, int& iter, int pn) const
+{
+  if (pn < 0 || pn > 2) error("unknown preconditioner in CG()");
+  if (pn == 1) {
+    jacobiprecond M(*this);
+    return pcg(*this, x, b, eps, iter, &M);
+  }
+  if (pn == 2) {
+    icprecond M(*this);
+    return pcg(*this, x, b, eps, iter, &M);
+  }
+  return pcg(*this, x, b, eps, iter, 0);
+} // end CG()
+
+int SparseMtx::CG(Vcr& x, const Vcr& b, double& eps, int& iter, const Preconditioner& M) const
+{
+  return pcg(*this, x, b, eps, iter, &M);
+}
+
+//---------------------------------------------------------------------------------
+// members of class SparseLDL
+//---------------------------------------------------------------------------------
+// up-looking sparse L D L^T factorization. the symbolic pass builds the
+// elimination tree and counts the entries of each column of L, the numeric
+// pass (refactor) computes row k of L from a sparse triangular solve along the tree.
+// with a permutation row k of P A P^T is row pp[k] of A renumbered by pinv
+SparseLDL::SparseLDL(const SparseMtx& A, const int* pp, bool sp)
+{
+  n = A.size();
+  single = sp;
+  const int* fnz = A.getfnz();
+  const int* clm = A.getclm();
+  lp = new int [n + 1];
+  d = 0; lx = 0; ds = 0; lxs = 0;
+  if (single) ds = new float [n];
+  else d = new double [n];
+  parent = new int [n];
+  perm = pinv = 0;
+  if (pp) {
+    perm = new int [n];
+    pinv = new int [n];
+    for (int k = 0; k < n; k++) pinv[k] = -1;
+    for (int k = 0; k < n; k++) {
+      if (pp[k] < 0 || pp[k] >= n || pinv[pp[k]] >= 0) error("invalid permutation in SparseLDL()");
+      perm[k] = pp[k];
+      pinv[pp[k]] = k;
+    }
+  }
+  int* lnz = new int [n];							// entries found in each column
+  int* flag = new int [n];							// flag[i] = k: i already visited for row k
+
+  // symbolic factorization
+  for (int k = 0; k < n; k++) {
+    parent[k] = -1;
+    flag[k] = k;
+    lnz[k] = 0;
+    const int kk = perm ? perm[k] : k;
+    for (int p = fnz[kk]; p < fnz[kk + 1]; p++) {
+      for (int i = pinv ? pinv[clm[p]] : clm[p]; i < k && flag[i] != k; i = parent[i]) {
+        if (parent[i] == -1) parent[i] = k;
+        lnz[i]++;
+        flag[i] = k;
+      }
+    }
+  }
+  lp[0] = 0;
+  for (int k = 0; k < n; k++) lp[k + 1] = lp[k] + lnz[k];
+  li = new int [lp[n]];
+  if (single) lxs = new float [lp[n]];
+  else lx = new double [lp[n]];
+  delete[] lnz; delete[] flag;
+
+  refactor(A);
+}
+// numeric factorization of row k = 0..n-1 of P A P^T on the elimination tree. the
+// row being computed is kept in double, entries of L and D are stored as T
+template <class T>
+static int ldlnumeric(int n, const int* fnz, const int* clm, const double* sra,
+                      const int* perm, const int* pinv, const int* parent,
+                      const int* lp, int* li, T* lx, T* d)
+{
+  int* lnz = new int [n];							// entries found so far in each column
+  int* flag = new int [n];							// flag[i] = k: i already visited for row k
+  int* pattern = new int [n];						// nonzero pattern of row k of L
+  double* y = new double [n];						// row k of L, scattered
+  int singular = 0;
+
+  for (int k = 0; k < n; k++) {
+    y[k] = 0.0;
+    int top = n;
+    flag[k] = k;
+    lnz[k] = 0;
+    const int kk = perm ? perm[k] : k;
+    for (int p = fnz[kk]; p < fnz[kk + 1]; p++) {
+      int i = pinv ? pinv[clm[p]] : clm[p];
+      if (i > k) continue;
+      y[i] += sra[p];
+      int len = 0;
+      for (; flag[i] != k; i = parent[i]) {
+        if (i < 0) error("matrix pattern differs in SparseLDL::refactor()");
+        pattern[len++] = i;
+        flag[i] = k;
+      }
+      while (len > 0) pattern[--top] = pattern[--len];
+    }
+    double dk = y[k];
+    y[k] = 0.0;
+    for (; top < n; top++) {
+      int i = pattern[top];
+      double yi = y[i];
+      y[i] = 0.0;
+      int p2 = lp[i] + lnz[i];
+      if (p2 >= lp[i + 1]) error("matrix pattern differs in SparseLDL::refactor()");
+      for (int p = lp[i]; p < p2; p++) y[li[p]] -= lx[p]*yi;
+      double lki = yi/d[i];
+      dk -= lki*yi;
+      li[p2] = k;
+      lx[p2] = (T)lki;
+      lnz[i]++;
+    }
+    d[k] = (T)dk;
+    if (d[k] == 0) {
+      singular = k + 1;
+      break;
+    }
+  }
+  delete[] lnz; delete[] flag; delete[] pattern; delete[] y;
+  return singular;
+}
+// numeric factorization of A on the stored symbolic factorization. A must have
+// the nonzero pattern the object was built with, only the values may change.
+// it returns info()
+int SparseLDL::refactor(const SparseMtx& A)
+{
+  if (A.size() != n) error("matrix size differs in SparseLDL::refactor()");
+  if (single)
+    singular = ldlnumeric(n, A.getfnz(), A.getclm(), A.getsra(), perm, pinv, parent, lp, li, lxs, ds);
+  else
+    singular = ldlnumeric(n, A.getfnz(), A.getclm(), A.getsra(), perm, pinv, parent, lp, li, lx, d);
+  return singular;
+}
+// destructor
+SparseLDL::~SparseLDL()
+{
+  delete[] lp; delete[] li; delete[] lx; delete[] d; delete[] lxs; delete[] ds; delete[] parent;
+  delete[] perm; delete[] pinv;
+}
+// solves A x = bb, x stored in bb
+void SparseLDL::solve(Vcr& bb) const
+{
+  if (n != bb.size()) error("matrix or vector sizes do not match");
+  solve(&bb[0], 1);
+}
+// solves A X = B for nrhs right sides stored row by row, so every entry of L
+// is loaded once and applied to all right sides. with an ordering the right
+// sides are gathered into P B and the solution scattered back
+void SparseLDL::solve(double* bb, int nrhs) const
+{
+  if (singular != 0) error("solve with singular factors in SparseLDL::solve()");
+  if (!perm) {
+    solveperm(bb, nrhs);
+    return;
+  }
+  double* x = new double [(long)n*nrhs];
+  for (int k = 0; k < n; k++) {
+    const double* bk = bb + (long)perm[k]*nrhs;
+    for (int r = 0; r < nrhs; r++) x[(long)k*nrhs + r] = bk[r];
+  }
+  solveperm(x, nrhs);
+  for (int k = 0; k < n; k++) {
+    double* bk = bb + (long)perm[k]*nrhs;
+    for (int r = 0; r < nrhs; r++) bk[r] = x[(long)k*nrhs + r];
+  }
+  delete[] x;
+}
+// the triangular solves with L, D and L^T, right sides in the factor's numbering.
+// the right sides are double whatever T the factors are stored in
+template <class T>
+static void ldlsolve(int n, const int* lp, const int* li, const T* lx, const T* d,
+                     double* bb, int nrhs)
+{
+  for (int j = 0; j < n; j++) {						// L Y = B
+    const double* bj = bb + (long)j*nrhs;
+    for (int p = lp[j]; p < lp[j + 1]; p++) {
+      double* bi = bb + (long)li[p]*nrhs;
+      const double l = lx[p];
+      for (int r = 0; r < nrhs; r++) bi[r] -= l*bj[r];
+    }
+  }
+  for (int j = 0; j < n; j++) {						// D Z = Y
+    double* bj = bb + (long)j*nrhs;
+    const double dj = 1.0/d[j];
+    for (int r = 0; r < nrhs; r++) bj[r] *= dj;
+  }
+  for (int j = n - 1; j >= 0; j--) {				// L^T X = Z
+    double* bj = bb + (long)j*nrhs;
+    for (int p = lp[j]; p < lp[j + 1]; p++) {
+      const double* bi = bb + (long)li[p]*nrhs;
+      const double l = lx[p];
+      for (int r = 0; r < nrhs; r++) bj[r] -= l*bi[r];
+    }
+  }
+}
+
+void SparseLDL::solveperm(double* bb, int nrhs) const
+{
+  if (single) ldlsolve(n, lp, li, lxs, ds, bb, nrhs);
+  else ldlsolve(n, lp, li, lx, d, bb, nrhs);
+}
@@ -1,57 +1,361 @@
 /*
 	MatVec.hpp
-	Interface for the calss Vcr and Mtx
+	Interface for the calss Vcr, Mtx and SparseMtx
 */
+#ifndef MATVEC_H_
+#define MATVEC_H_
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+// wrong sizes, singular matrices and bad arguments are reported by throwing
+// MatVecError, the library never ends the process
+class MatVecError : public std::runtime_error {
+public:
+  explicit MatVecError(const char* t) : std::runtime_error(t) {}
+};
+
+void error(const char* t);							// throws MatVecError(t), in MatVec.cpp
+
+//---------------------------------------------------------------------------------
+// VECTOR EXPRESSIONS
+//---------------------------------------------------------------------------------
+// v = a + s*b, y += a*x and dot(r, b - c) are evaluated entry by entry in one
+// loop, without vectors for the intermediate results. every vector or expression
+// derives from VcrExpr<itself>; vectors are held by reference inside an expression,
+// expressions by value, so an expression must be used in the statement that builds it
+template<class E> struct VcrExpr {
+  const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// how an operand is held inside an expression
+template<class E> struct VcrOperand { typedef const E type; };
+
+template<class A, class B, class Op>
+class VcrBinary : public VcrExpr<VcrBinary<A, B, Op> > {
+  typename VcrOperand<A>::type a;
+  typename VcrOperand<B>::type b;
+public:
+  typedef typename std::common_type<typename A::value_type, typename B::value_type>::type value_type;
+  VcrBinary(const A& x, const B& y) : a(x), b(y) {
+    if (a.size() != b.size()) error("bad vector sizes in vector expression");
+  }
+  int size() const { return a.size(); }
+  value_type operator[](int i) const { return Op::apply(a[i], b[i]); }
+};
+
+template<class A>
+class VcrScaled : public VcrExpr<VcrScaled<A> > {
+public:
+  typedef typename A::value_type value_type;
+  VcrScaled(value_type s, const A& x) : t(s), a(x) {}
+  int size() const { return a.size(); }
+  value_type operator[](int i) const { return t*a[i]; }
+private:
+  value_type t;
+  typename VcrOperand<A>::type a;
+};
+
+struct VcrAdd { template<class T> static T apply(T x, T y) { return x + y; } };
+struct VcrSub { template<class T> static T apply(T x, T y) { return x - y; } };
+
+template<class A, class B>
+VcrBinary<A, B, VcrAdd> operator+(const VcrExpr<A>& a, const VcrExpr<B>& b) {
+  return VcrBinary<A, B, VcrAdd>(a.self(), b.self());
+}
+template<class A, class B>
+VcrBinary<A, B, VcrSub> operator-(const VcrExpr<A>& a, const VcrExpr<B>& b) {
+  return VcrBinary<A, B, VcrSub>(a.self(), b.self());
+}
+template<class A>
+VcrScaled<A> operator*(typename A::value_type s, const VcrExpr<A>& a) {
+  return VcrScaled<A>(s, a.self());
+}
+template<class A>
+VcrScaled<A> operator*(const VcrExpr<A>& a, typename A::value_type s) {
+  return VcrScaled<A>(s, a.self());
+}
+
+// reductions over vectors and expressions, summed in double
+template<class A, class B>
+double dot(const VcrExpr<A>& x, const VcrExpr<B>& y) {
+  const A& a = x.self();
+  const B& b = y.self();
+  if (a.size() != b.size()) error("bad vector sizes in dot product");
+  double tm = 0.0;
+  for (int i = 0; i < a.size(); i++) tm += (double)a[i]*(double)b[i];
+  return tm;
+}
+template<class A> double onenorm(const VcrExpr<A>& x) {
+  const A& a = x.self();
+  double norm = 0.0;
+  for (int i = 0; i < a.size(); i++) norm += std::fabs((double)a[i]);
+  return norm;
+}
+template<class A> double twonorm(const VcrExpr<A>& x) {
+  return std::sqrt(dot(x, x));
+}
+template<class A> double maxnorm(const VcrExpr<A>& x) {
+  const A& a = x.self();
+  double norm = 0.0;
+  for (int i = 0; i < a.size(); i++) {
+    double t = std::fabs((double)a[i]);
+    if (t > norm) norm = t;
+  }
+  return norm;
+}
+
 //---------------------------------------------------------------------------------
 // CLASS Vcr (VECTOR)
 //---------------------------------------------------------------------------------
-class Vcr {       
+enum adoptbuffer { ADOPT };							// constructor tag: take over an array
+
+template<class T> class Vector : public VcrExpr<Vector<T> > {
 
 private:
   int lenth;										// number of entries 
-  double* vr;										// entries of the vector
+  T* vr;											// entries of the vector
 
 public: 
-  Vcr(int n, double*);							// constructor, all entries = t
-  Vcr(const Vcr&);									// copy constructor
-  Vcr& operator=(const Vcr&);						// copy assignment
-  ~Vcr(){ delete[] vr; }							// destructor
+  typedef T value_type;
+  Vector(int n, const T*);							// constructor, entries copied from array
+  Vector(int n, T* a, adoptbuffer)					// constructor, owns a from now on, which
+    : lenth(n), vr(a) {}							// must come from new T[n]
+  Vector(int n, T t = 0);							// constructor, all entries = t
+  Vector(const Vector&);							// copy constructor
+  Vector(Vector&& v) noexcept : lenth(v.lenth), vr(v.vr) {	// move constructor, v is left
+    v.lenth = 0; v.vr = 0;							// empty
+  }
+  template<class E> Vector(const VcrExpr<E>& e);	// evaluates e into a new vector
+  Vector& operator=(const Vector&);					// copy assignment, same sizes
+  Vector& operator=(Vector&& v) noexcept {			// move assignment, the storage is
+    int n = lenth; lenth = v.lenth; v.lenth = n;		// exchanged, sizes may differ
+    T* p = vr; vr = v.vr; v.vr = p;
+    return *this;
+  }
+  template<class E> Vector& operator=(const VcrExpr<E>& e);	// v = a + s*b, same sizes
+  template<class E> Vector& operator+=(const VcrExpr<E>& e);	// v += s*x is an axpy
+  template<class E> Vector& operator-=(const VcrExpr<E>& e);
+  ~Vector(){ delete[] vr; }							// destructor
+  T* release() { T* p = vr; vr = 0; lenth = 0; return p; }	// gives up the array, for
+														// delete[] by the caller
 
-  double& operator[](int i) const { return vr[i]; }	// subscript, e.g. v[3] = 1.2
+  T& operator[](int i) const { return vr[i]; }		// subscript, e.g. v[3] = 1.2
 
   int size() const { return lenth; }				// return size of vector
   double onenorm() const;							// one norm
   double twonorm() const;							// two norm
   double maxnorm() const;							// maximum norm
   void print() const;	// print vector
-  double getvalues(int);
-  friend double dot(const Vcr& v1, const Vcr& v2);	// a friend
+  T getvalues(int);
 };
 
+template<class T> struct VcrOperand<Vector<T> > { typedef const Vector<T>& type; };
+
+template<class T> template<class E>
+Vector<T>::Vector(const VcrExpr<E>& e) {
+  const E& x = e.self();
+  vr = new T [lenth = x.size()];
+  for (int i = 0; i < lenth; i++) vr[i] = x[i];
+}
+template<class T> template<class E>
+Vector<T>& Vector<T>::operator=(const VcrExpr<E>& e) {
+  const E& x = e.self();
+  if (lenth != x.size()) error("bad vector sizes in Vcr::operator=()");
+  for (int i = 0; i < lenth; i++) vr[i] = x[i];
+  return *this;
+}
+template<class T> template<class E>
+Vector<T>& Vector<T>::operator+=(const VcrExpr<E>& e) {
+  const E& x = e.self();
+  if (lenth != x.size()) error("bad vector sizes in Vcr::operator+=()");
+  for (int i = 0; i < lenth; i++) vr[i] += x[i];
+  return *this;
+}
+template<class T> template<class E>
+Vector<T>& Vector<T>::operator-=(const VcrExpr<E>& e) {
+  const E& x = e.self();
+  if (lenth != x.size()) error("bad vector sizes in Vcr::operator-=()");
+  for (int i = 0; i < lenth; i++) vr[i] -= x[i];
+  return *this;
+}
+
+typedef Vector<double> Vcr;
+typedef Vector<float> Vcrf;
+
 //---------------------------------------------------------------------------------
 // CLASS Mtx (MATRIX)
 //---------------------------------------------------------------------------------
-class Mtx {											// square matrix
+template<class T> class Matrix {					// square matrix
 
 private: 
   int dimn;											// dimension of matrix
-  double** mx;										// entries of the matrix
+  int ld;											// row stride, dimn rounded up to a whole
+													// number of SIMD registers
+  T* mx;											// entries of the matrix in one aligned
+													// buffer, row i starts at mx + i*ld
 
 public: 
-  Mtx(int n, double** a);							// constructor, all entries = t
-  Mtx(const Mtx& );									// copy constructor
-  Mtx& operator=(const Mtx&);						// copy assignment
-  ~Mtx(){											// destructor
-    for (int i = 0; i< dimn; i++) delete[]  mx[i];
-    delete[] mx;
+  typedef T value_type;
+  Matrix(int n, T** a);								// constructor, entries copied from a[i][j]
+  Matrix(int n, T t = 0);							// constructor, all entries = t
+  Matrix(const Matrix& );							// copy constructor
+  Matrix(Matrix&& M) noexcept : dimn(M.dimn), ld(M.ld), mx(M.mx) {	// move constructor, M is
+    M.dimn = M.ld = 0; M.mx = 0;					// left empty
   }
+  Matrix& operator=(const Matrix&);					// copy assignment
+  Matrix& operator=(Matrix&& M) noexcept {			// move assignment, the storage is
+    int n = dimn; dimn = M.dimn; M.dimn = n;			// exchanged, sizes may differ
+    n = ld; ld = M.ld; M.ld = n;
+    T* p = mx; mx = M.mx; M.mx = p;
+    return *this;
+  }
+  ~Matrix();										// destructor
 
-  double* operator[](int i) const { return mx[i]; }	// subscript, entry at row i and
+  T* operator[](int i) const { return mx + (long)i*ld; }	// subscript, entry at row i and
 													// column j is [i][j]
 
+  int size() const { return dimn; }					// dimension of matrix
   double onenorm() const;							// one norm
   double maxnorm() const;							// maximum norm
   double frobnorm() const;							// Frobenius norm
-  void GaussElim(Vcr& bb) const;					// Gaussian elimination A x = bb
+  void GaussElim(Vector<T>& bb) const &;			// Gaussian elimination A x = bb, on a
+													// copy of the matrix
+  void GaussElim(Vector<T>& bb) &&;					// the same on a matrix about to go away:
+													// factored in place, no copy
   void print() const;								// print matrix
-};
\ No newline at end of file
+};
+
+typedef Matrix<double> Mtx;
+typedef Matrix<float> Mtxf;
+
+//---------------------------------------------------------------------------------
+// CLASS LUMtx (LU FACTORS OF A Mtx)
+//---------------------------------------------------------------------------------
+template<class T> class LUMatrix {					// P A = L U with partial pivoting
+
+private:
+  Matrix<T> lu;										// L below the diagonal (unit diagonal
+													// not stored), U on and above it
+  int* piv;											// row k was swapped with row piv[k]
+  int singular;										// 0, or k+1 if U(k,k) is exactly zero
+
+  void factor();									// factors lu in place
+
+public:
+  LUMatrix(const Matrix<T>& A);						// blocked factorization, trailing
+													// updates run on threadpool::shared()
+  LUMatrix(Matrix<T>&& A);							// the same in the storage of A
+  LUMatrix(const LUMatrix&);						// copy constructor
+  LUMatrix& operator=(const LUMatrix&) = delete;
+  ~LUMatrix(){ delete[] piv; }						// destructor
+
+  int size() const { return lu.size(); }			// dimension of matrix
+  int info() const { return singular; }				// 0 if the factors can be used
+  void solve(Vector<T>& bb) const;					// solves A x = bb, x stored in bb
+};
+
+typedef LUMatrix<double> LUMtx;
+
+//---------------------------------------------------------------------------------
+// CLASS Preconditioner
+//---------------------------------------------------------------------------------
+class Preconditioner {								// z = M^-1 r for CG, M symmetric
+													// positive definite
+public:
+  virtual ~Preconditioner() {}
+  virtual void apply(const Vcr& r, Vcr& z) const = 0;
+};
+
+//---------------------------------------------------------------------------------
+// CLASS SparseMtx (SPARSE MATRIX, COMPRESSED SPARSE ROW)
+//---------------------------------------------------------------------------------
+class SparseMtx {									// square sparse matrix
+
+private:
+  int nrows;										// number of rows
+  int lenth;										// number of stored entries
+  double* sra;										// stored entries, row by row
+  int* clm;											// column index of each entry in sra
+  int* fnz;											// position in sra of the first entry of
+													// each row, fnz[nrows] = lenth
+
+public:
+  SparseMtx(int n, int m, double* t, int* c, int* f);	// constructor, copies CSR arrays
+  SparseMtx(int n, int m, const int* ia, const int* ja,
+            const double* a);						// assembly from m (i,j,a) triplets,
+													// duplicates are summed
+  SparseMtx(const SparseMtx&);						// copy constructor
+  SparseMtx(SparseMtx&&) noexcept;					// move constructor
+  SparseMtx& operator=(const SparseMtx&);			// copy assignment
+  SparseMtx& operator=(SparseMtx&&) noexcept;		// move assignment
+  ~SparseMtx(){										// destructor
+    delete[] sra; delete[] clm; delete[] fnz;
+  }
+
+  double operator()(int i, int j) const;			// entry at row i and column j
+  int find(int i, int j) const;						// position of (i,j) in sra, -1 if absent
+  int size() const { return nrows; }				// number of rows
+  int nnz() const { return lenth; }					// number of stored entries
+  const double* getsra() const { return sra; }		// raw CSR arrays, for the
+  const int* getclm() const { return clm; }			// factorizations below
+  const int* getfnz() const { return fnz; }
+  double* getsra() { return sra; }					// values may be changed in place,
+													// the pattern stays
+  Vcr operator*(const Vcr&) const;					// matrix vector multiply
+  double onenorm() const;							// one norm, largest column sum
+  int CG(Vcr& x, const Vcr& b, double& eps,
+         int& iter, int pn = 0) const;				// preconditioned conjugate gradient
+													// for SPD A x = b, pn = 0: none,
+													// 1: Jacobi, 2: incomplete Cholesky
+  int CG(Vcr& x, const Vcr& b, double& eps,
+         int& iter, const Preconditioner& M) const;	// the same with a preconditioner
+													// set up once for many solves
+  void print() const;								// print stored entries
+};
+
+//---------------------------------------------------------------------------------
+// CLASS SparseLDL (SPARSE L D L^T FACTORS OF A SYMMETRIC SparseMtx)
+//---------------------------------------------------------------------------------
+class SparseLDL {									// A = L D L^T, L unit lower triangular
+
+private:
+  int n;											// dimension of matrix
+  int* lp;											// column j of L is li/lx[lp[j]..lp[j+1])
+  int* li;											// row index of each entry of L
+  double* lx;										// entries of L below the diagonal
+  double* d;										// diagonal D
+  float* lxs;										// lx and d in single precision, used
+  float* ds;										// instead of them when single is set
+  bool single;
+  int* parent;										// elimination tree, -1 at a root
+  int* perm;										// row perm[k] of A is row k of L, or 0
+  int* pinv;										// inverse of perm
+  int singular;										// 0, or k+1 if D(k,k) is zero
+
+  void solveperm(double* bb, int nrhs) const;		// the solve on P A P^T
+
+public:
+  SparseLDL(const SparseMtx& A, const int* pp = 0, bool sp = false);	// symbolic and numeric
+													// factorization of P A P^T, pp[k] = row
+													// of A taken k-th (0 for none); the
+													// lower triangle of P A P^T is read.
+													// sp: factors stored in single precision,
+													// half the memory traffic of a solve
+  int refactor(const SparseMtx& A);					// numeric factorization only, A has the
+													// same pattern and new values
+  SparseLDL(const SparseLDL&) = delete;
+  SparseLDL& operator=(const SparseLDL&) = delete;
+  ~SparseLDL();										// destructor
+
+  int size() const { return n; }					// dimension of matrix
+  int nnz() const { return lp[n]; }					// entries of L below the diagonal
+  int info() const { return singular; }				// 0 if the factors can be used
+  bool issingle() const { return single; }			// factors in single precision
+  const int* permutation() const { return perm; }	// the ordering used, or 0
+  void solve(Vcr& bb) const;						// solves A x = bb, x stored in bb
+  void solve(double* bb, int nrhs) const;			// nrhs right sides at once, entry i of
+													// right side r is bb[i*nrhs + r], in
+													// the numbering of A
+};
+#endif
@@ -0,0 +1,382 @@
+/*
+	amg.cpp
+	smoothed aggregation multigrid: setup of the levels and the V-cycle
+*/
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "MatVec.h"
+#include "amg.h"
+#include "ordering.h"
+#include "threadpool.h"
+
+using namespace std;
+
+void error(const char* t);							// in MatVec.cpp, throws MatVecError
+
+static const int AMG_COARSEST = 1000;				// rows factored directly
+static const int AMG_MAXLEVELS = 30;
+static const int AMG_BLOCK = 4096;					// rows of one smoothing block, the unit
+													// of parallel work
+static const double AMG_THETA = 0.08;				// strength of connection on level 0,
+													// halved on every coarser level
+static const double AMG_MAXRATIO = 0.85;			// coarsening stops when a level keeps
+													// more of its rows than this
+
+// body(lo, hi) on the blocks of AMG_BLOCK rows of [0,n), in parallel
+template<class Body> static void forblocks(int n, const Body& body)
+{
+  const int nb = (n + AMG_BLOCK - 1)/AMG_BLOCK;
+  if (nb <= 1) {
+    body(0, n);
+    return;
+  }
+  threadpool::shared().parallel_for(nb, [&](int t) {
+    int lo = t*AMG_BLOCK;
+    body(lo, (n - lo < AMG_BLOCK) ? n : lo + AMG_BLOCK);
+  });
+}
+
+// fills C, rows x cols, from row(i, acc): the entries of row i are passed to
+// acc(column, value), repeated columns are summed. one pass counts, a second
+// fills, each over blocks of rows in parallel; columns end up sorted in each row
+template<class Row> static void buildrows(int rows, int cols, vector<int>& fnz,
+                                          vector<int>& clm, vector<double>& sra, const Row& row)
+{
+  threadpool& pool = threadpool::shared();
+  const int nb = (rows + AMG_BLOCK - 1)/AMG_BLOCK;
+  vector<vector<int> > owner(pool.size()), pos(pool.size());	// per thread: last row to
+													// touch a column, its place in that row
+  fnz.assign(rows + 1, 0);
+  pool.parallel_for(nb, [&](int t, int slot) {
+    vector<int>& own = owner[slot];
+    if (own.empty()) own.assign(cols, -1);
+    int ie = (rows - t*AMG_BLOCK < AMG_BLOCK) ? rows : (t + 1)*AMG_BLOCK;
+    for (int i = t*AMG_BLOCK; i < ie; i++) {
+      int cnt = 0;
+      row(i, [&](int c, double) { if (own[c] != i) { own[c] = i; cnt++; } });
+      fnz[i + 1] = cnt;
+    }
+  });
+  for (int i = 0; i < rows; i++) fnz[i + 1] += fnz[i];
+  clm.resize(fnz[rows]);
+  sra.resize(fnz[rows]);
+  pool.parallel_for(nb, [&](int t, int slot) {
+    vector<int>& own = owner[slot];
+    vector<int>& at = pos[slot];
+    if (own.empty()) own.assign(cols, -1);
+    if (at.empty()) at.resize(cols);
+    int ie = (rows - t*AMG_BLOCK < AMG_BLOCK) ? rows : (t + 1)*AMG_BLOCK;
+    for (int i = t*AMG_BLOCK; i < ie; i++) {
+      const int stamp = rows + i;					// distinct from the counting pass
+      int end = fnz[i];
+      row(i, [&](int c, double v) {
+        if (own[c] != stamp) {
+          own[c] = stamp;
+          at[c] = end;
+          clm[end] = c;
+          sra[end++] = v;
+        }
+        else sra[at[c]] += v;
+      });
+      for (int p = fnz[i] + 1; p < end; p++) {		// insertion sort, rows are short
+        int c = clm[p];
+        double v = sra[p];
+        int q = p - 1;
+        for (; q >= fnz[i] && clm[q] > c; q--) { clm[q + 1] = clm[q]; sra[q + 1] = sra[q]; }
+        clm[q + 1] = c;
+        sra[q + 1] = v;
+      }
+    }
+  });
+}
+
+AMGPrecond::AMGPrecond(const SparseMtx& A) : bottom(0)
+{
+  try {
+    build(A, false);
+  }
+  catch (...) {										// the levels built so far are owned
+    clear();										// by no one else
+    throw;
+  }
+}
+
+AMGPrecond::~AMGPrecond()
+{
+  clear();
+}
+
+void AMGPrecond::clear()
+{
+  for (size_t l = 0; l < coarse.size(); l++) delete coarse[l];
+  coarse.clear();
+  delete bottom;
+  bottom = 0;
+  levels.clear();
+}
+
+void AMGPrecond::refresh(const SparseMtx& A)
+{
+  if (A.size() != levels[0].A->size())
+    error("matrix size changed in AMGPrecond::refresh()");
+  build(A, true);
+}
+
+// strong neighbours of i are the j != i with |a_ij| >= theta sqrt(|a_ii a_jj|).
+// 1: a row whose strong neighbours are all free starts an aggregate with them,
+// 2: the rows left join the aggregate of step 1 they are most strongly tied to,
+// 3: rows still left group with their free strong neighbours. rows without any
+// strong neighbour, the fixed heads among them, stay out (agg -1): the smoother
+// alone takes care of them
+int AMGPrecond::aggregate(level& L, double theta) const
+{
+  const SparseMtx& A = *L.A;
+  const int n = A.size();
+  const int* fnz = A.getfnz();
+  const int* clm = A.getclm();
+  const double* sra = A.getsra();
+  vector<double> diag(n, 0.0);
+  for (int i = 0; i < n; i++)
+    for (int k = fnz[i]; k < fnz[i + 1]; k++)
+      if (clm[k] == i) diag[i] = fabs(sra[k]);
+  auto strong = [&](int i, int k) {
+    int j = clm[k];
+    return j != i && fabs(sra[k]) >= theta*sqrt(diag[i]*diag[j]) && sra[k] != 0.0;
+  };
+
+  vector<int>& agg = L.agg;
+  agg.assign(n, -1);
+  int na = 0;
+  for (int i = 0; i < n; i++) {
+    if (agg[i] != -1) continue;
+    bool any = false, free = true;
+    for (int k = fnz[i]; k < fnz[i + 1] && free; k++)
+      if (strong(i, k)) {
+        any = true;
+        free = (agg[clm[k]] == -1);
+      }
+    if (!any || !free) continue;
+    agg[i] = na;
+    for (int k = fnz[i]; k < fnz[i + 1]; k++)
+      if (strong(i, k)) agg[clm[k]] = na;
+    na++;
+  }
+  vector<int> first(agg);
+  for (int i = 0; i < n; i++) {
+    if (agg[i] != -1) continue;
+    double w = 0.0;
+    for (int k = fnz[i]; k < fnz[i + 1]; k++)
+      if (strong(i, k) && first[clm[k]] >= 0 && fabs(sra[k]) > w) {
+        w = fabs(sra[k]);
+        agg[i] = first[clm[k]];
+      }
+  }
+  for (int i = 0; i < n; i++) {
+    if (agg[i] != -1) continue;
+    bool any = false;
+    for (int k = fnz[i]; k < fnz[i + 1]; k++)
+      if (strong(i, k)) {
+        any = true;
+        if (agg[clm[k]] == -1) agg[clm[k]] = na;
+      }
+    if (any) agg[i] = na++;
+  }
+  return na;
+}
+
+// levels from A down to AMG_COARSEST rows; keep: reuse the aggregates of the
+// levels built before
+void AMGPrecond::build(const SparseMtx& A, bool keep)
+{
+  vector<vector<int> > kept;
+  if (keep)
+    for (size_t l = 0; l < levels.size(); l++) kept.push_back(levels[l].agg);
+  clear();
+
+  const SparseMtx* cur = &A;
+  double theta = AMG_THETA;
+  for (int l = 0; ; l++, theta *= 0.5) {
+    levels.push_back(level());
+    level& L = levels.back();
+    const SparseMtx& Al = *cur;
+    const int n = Al.size();
+    const int* fnz = Al.getfnz();
+    const int* clm = Al.getclm();
+    const double* sra = Al.getsra();
+    L.A = cur;
+    L.x.resize(n);
+    L.b.resize(n);
+    L.r.resize(n);
+
+    // l1 pivots of the smoother: a_ii plus the entries coupling row i to other blocks
+    L.pivot.assign(n, 0.0);
+    vector<double> diag(n, 0.0);
+    for (int i = 0; i < n; i++) {
+      int lo = i/AMG_BLOCK*AMG_BLOCK, hi = lo + AMG_BLOCK;
+      for (int k = fnz[i]; k < fnz[i + 1]; k++) {
+        if (clm[k] == i) diag[i] = sra[k];
+        else if (clm[k] < lo || clm[k] >= hi) L.pivot[i] += fabs(sra[k]);
+      }
+      L.pivot[i] += diag[i];
+      if (L.pivot[i] == 0.0) error("zero row in AMGPrecond");
+    }
+
+    if (n <= AMG_COARSEST || l + 1 >= AMG_MAXLEVELS) break;
+    int na = 0;
+    if (l < (int)kept.size() && !kept[l].empty()) {
+      L.agg.swap(kept[l]);
+      for (int i = 0; i < n; i++) na = max(na, L.agg[i] + 1);
+    }
+    else na = aggregate(L, theta);
+    if (na == 0 || na > AMG_MAXRATIO*n) {			// nothing left to coarsen
+      L.agg.clear();
+      break;
+    }
+    const int* agg = L.agg.data();
+
+    // P = (I - omega D^-1 A) P0, P0 the 0/1 aggregate matrix, omega = 4/(3 rho)
+    // with rho >= the spectral radius of D^-1 A from the row sums
+    double rho = 0.0;
+    for (int i = 0; i < n; i++) {
+      double s = 0.0;
+      for (int k = fnz[i]; k < fnz[i + 1]; k++) s += fabs(sra[k]);
+      if (diag[i] != 0.0) rho = max(rho, s/fabs(diag[i]));
+    }
+    const double omega = (rho > 0.0) ? 4.0/(3.0*rho) : 0.0;
+    csr& P = L.P;
+    P.rows = n;
+    P.cols = na;
+    buildrows(n, na, P.fnz, P.clm, P.sra, [&](int i, auto acc) {
+      double s = (diag[i] != 0.0) ? -omega/diag[i] : 0.0;
+      for (int k = fnz[i]; k < fnz[i + 1]; k++)
+        if (agg[clm[k]] >= 0) acc(agg[clm[k]], s*sra[k]);
+      if (agg[i] >= 0) acc(agg[i], 1.0);
+    });
+
+    // R = P^T by a counting sort on the columns
+    csr& R = L.R;
+    R.rows = na;
+    R.cols = n;
+    R.fnz.assign(na + 1, 0);
+    for (size_t p = 0; p < P.clm.size(); p++) R.fnz[P.clm[p] + 1]++;
+    for (int c = 0; c < na; c++) R.fnz[c + 1] += R.fnz[c];
+    R.clm.resize(P.clm.size());
+    R.sra.resize(P.clm.size());
+    {
+      vector<int> next(R.fnz.begin(), R.fnz.end() - 1);
+      for (int i = 0; i < n; i++)
+        for (int p = P.fnz[i]; p < P.fnz[i + 1]; p++) {
+          int q = next[P.clm[p]]++;
+          R.clm[q] = i;
+          R.sra[q] = P.sra[p];
+        }
+    }
+
+    // Galerkin product R (A P)
+    csr AP;
+    buildrows(n, na, AP.fnz, AP.clm, AP.sra, [&](int i, auto acc) {
+      for (int k = fnz[i]; k < fnz[i + 1]; k++) {
+        int j = clm[k];
+        for (int p = P.fnz[j]; p < P.fnz[j + 1]; p++) acc(P.clm[p], sra[k]*P.sra[p]);
+      }
+    });
+    csr C;
+    buildrows(na, na, C.fnz, C.clm, C.sra, [&](int c, auto acc) {
+      for (int q = R.fnz[c]; q < R.fnz[c + 1]; q++) {
+        int i = R.clm[q];
+        for (int p = AP.fnz[i]; p < AP.fnz[i + 1]; p++) acc(AP.clm[p], R.sra[q]*AP.sra[p]);
+      }
+    });
+    coarse.push_back(new SparseMtx(na, (int)C.sra.size(), C.sra.data(), C.clm.data(), C.fnz.data()));
+    cur = coarse.back();
+  }
+
+  const SparseMtx& Ac = *levels.back().A;
+  vector<int> perm(Ac.size());
+  fillorder(Ac, ORDER_AMD, perm.data());
+  bottom = new SparseLDL(Ac, perm.data());
+  if (bottom->info() != 0) error("singular coarsest matrix in AMGPrecond");
+}
+
+double AMGPrecond::complexity() const
+{
+  double total = 0.0;
+  for (size_t l = 0; l < levels.size(); l++) total += levels[l].A->nnz();
+  return total/levels[0].A->nnz();
+}
+
+// one sweep of l1 Gauss-Seidel on A x = b, rows in order within each block
+// (reversed when back), values of the other blocks from before the sweep
+static void smooth(const SparseMtx& A, const double* pivot, const double* b,
+                   double* x, double* old, bool back)
+{
+  const int n = A.size();
+  const int* fnz = A.getfnz();
+  const int* clm = A.getclm();
+  const double* sra = A.getsra();
+  memcpy(old, x, n*sizeof(double));
+  forblocks(n, [&](int lo, int hi) {
+    for (int t = 0; t < hi - lo; t++) {
+      int i = back ? hi - 1 - t : lo + t;
+      double s = b[i];
+      for (int k = fnz[i]; k < fnz[i + 1]; k++) {
+        int j = clm[k];
+        s -= sra[k]*((j >= lo && j < hi) ? x[j] : old[j]);
+      }
+      x[i] += s/pivot[i];
+    }
+  });
+}
+
+void AMGPrecond::cycle(int l) const
+{
+  const level& L = levels[l];
+  double* x = L.x.data();
+  const double* b = L.b.data();
+  const int n = L.A->size();
+  if (l + 1 == (int)levels.size()) {				// coarsest: direct solve
+    memcpy(x, b, n*sizeof(double));
+    bottom->solve(x, 1);
+    return;
+  }
+  const level& C = levels[l + 1];
+  const int* fnz = L.A->getfnz();
+  const int* clm = L.A->getclm();
+  const double* sra = L.A->getsra();
+  double* r = L.r.data();
+
+  for (int i = 0; i < n; i++) x[i] = 0.0;
+  smooth(*L.A, L.pivot.data(), b, x, r, false);
+  forblocks(n, [&](int lo, int hi) {				// r = b - A x
+    for (int i = lo; i < hi; i++) {
+      double s = b[i];
+      for (int k = fnz[i]; k < fnz[i + 1]; k++) s -= sra[k]*x[clm[k]];
+      r[i] = s;
+    }
+  });
+  double* bc = C.b.data();
+  forblocks(L.R.rows, [&](int lo, int hi) {		// restriction
+    for (int c = lo; c < hi; c++) {
+      double s = 0.0;
+      for (int q = L.R.fnz[c]; q < L.R.fnz[c + 1]; q++) s += L.R.sra[q]*r[L.R.clm[q]];
+      bc[c] = s;
+    }
+  });
+  cycle(l + 1);
+  const double* xc = C.x.data();
+  forblocks(n, [&](int lo, int hi) {				// coarse correction
+    for (int i = lo; i < hi; i++)
+      for (int p = L.P.fnz[i]; p < L.P.fnz[i + 1]; p++) x[i] += L.P.sra[p]*xc[L.P.clm[p]];
+  });
+  smooth(*L.A, L.pivot.data(), b, x, r, true);
+}
+
+void AMGPrecond::apply(const Vcr& r, Vcr& z) const
+{
+  const int n = levels[0].A->size();
+  if (r.size() != n || z.size() != n) error("bad vector sizes in AMGPrecond::apply()");
+  memcpy(levels[0].b.data(), &r[0], n*sizeof(double));
+  cycle(0);
+  memcpy(&z[0], levels[0].x.data(), n*sizeof(double));
+}
@@ -0,0 +1,65 @@
+/*
+	amg.h
+	Smoothed aggregation algebraic multigrid, a preconditioner for CG on the
+	network matrix
+*/
+#ifndef AMG_H_
+#define AMG_H_
+#include <vector>
+#include "MatVec.h"
+
+//---------------------------------------------------------------------------------
+// CLASS AMGPrecond
+//---------------------------------------------------------------------------------
+// the network matrix is a weighted graph Laplacian with unit rows at the fixed
+// heads. nodes are grouped into aggregates of strongly connected neighbours, a
+// chain of pipes into runs of three, and every aggregate is one unknown of the
+// next coarser level. the piecewise constant prolongation is smoothed by one
+// damped Jacobi step, the coarse matrices are the Galerkin products P^T A P and
+// the coarsest one is factored. apply() is one V-cycle with l1 Gauss-Seidel on
+// fixed blocks of rows, forward before and backward after the coarse correction,
+// so the cycle is symmetric and its result does not depend on the thread count.
+// setup and cycle are linear in the entries of A
+class AMGPrecond : public Preconditioner {
+
+private:
+  struct csr {										// rectangular sparse matrix
+    int rows, cols;
+    std::vector<int> fnz, clm;
+    std::vector<double> sra;
+  };
+  struct level {
+    const SparseMtx* A;								// matrix of this level
+    std::vector<int> agg;							// aggregate of each row, -1 for none
+    csr P, R;										// prolongation to this level from the
+													// next, and its transpose
+    std::vector<double> pivot;						// l1 pivots of the smoother
+    mutable std::vector<double> x, b, r;			// vectors of one cycle
+  };
+  std::vector<level> levels;
+  std::vector<SparseMtx*> coarse;					// matrices of levels 1.., owned
+  SparseLDL* bottom;								// factors of the coarsest matrix
+
+  void build(const SparseMtx& A, bool keep);
+  int aggregate(level& L, double theta) const;	// fills L.agg, returns the number
+													// of aggregates
+  void cycle(int l) const;							// levels[l].x from levels[l].b
+  void clear();
+
+public:
+  AMGPrecond(const SparseMtx& A);					// setup for A, which must stay in place
+													// as long as this is used
+  AMGPrecond(const AMGPrecond&) = delete;
+  AMGPrecond& operator=(const AMGPrecond&) = delete;
+  ~AMGPrecond();
+
+  void refresh(const SparseMtx& A);					// new values of A, or a few entries
+													// more: the aggregates are kept and
+													// the rest of the setup redone
+  void apply(const Vcr& r, Vcr& z) const;			// z = one V-cycle on r; one call at a
+													// time, the cycle vectors are shared
+  int depth() const { return (int)levels.size(); }	// number of levels
+  int rows(int l) const { return levels[l].A->size(); }	// rows of level l
+  double complexity() const;						// entries of all levels over those of A
+};
+#endif
@@ -3,59 +3,151 @@
 #include<iostream>
 #include<fstream>
 #include<string>
+#include<vector>
 using namespace std;
 
-//CLASS NODE
-class node
+class SparseMtx;
+class SparseLDL;
+class SchurSolver;
+class AMGPrecond;
+struct netdata;
+class netsnapshot;
+struct solvestats;
+
+//laminar conductance B of a tube from its diameter and length, q = B dh
+double conductance(double,double);
+
+//STRUCT NETCORE: a whole network as one contiguous array per quantity,
+//the loops over nodes and tubes below run straight down these arrays
+struct netcore
 {
-private:
-	int num; //node number
-	double x,y,Q,head;// x-coords,y-coords,flowrate,head
-public:
-	node(int number,double a,double b,double flow):num(number),x(a),y(b),Q(flow){} //constructor:member initialization
-	double getx();
-	double gety();
-	int getnum();
-	double gethead();
-	double getQ();
-	//void display(); 
-	void definehead(double);
-	//~node();
+	int n_nodes = 0;
+	int n_tubes = 0;
+	vector<double> x, y, Q, head; //per node: coordinates, flowrate, head
+	vector<char> fixed; //per node: head is prescribed (node 1 at 0 by default)
+	vector<int> n1, n2; //per tube: end nodes, 0-based
+	vector<double> dia, length, B, q; //per tube: diameter, length, B coefficient, flow
+	void resize(int,int); //nodes, tubes
+	void calclength(); //length of every tube
+	void calcB(); //B of every tube from dia and length
+	void calcflow(); //flow of every tube from the heads
+	int components(vector<int>&) const; //connected component of every node over the open tubes,
+		//numbered in order of their first node; returns the number of components
 };
 
-//CLASS TUBE
-class tube
+//outcome of the last factorize(), solve() or solvescenarios(), see pipenet::getstatus()
+enum solvestatus
 {
-private:
-	int num,nodeone,nodetwo;
-	double dia;
-	double length,B,q; //iniialized using the functions below
-	node* a; //a points to public members of class node
-	node* b; //b points to public members of class node
-public:
-	tube(int,node*,node*,int,int,double);
-	void calclength();
-	void calcB();
-	//void display();
-	int getn1();
-	int getn2();
-	double getB();
-	void displayflow();
+	SOLVE_OK = 0,
+	SOLVE_NOT_CONVERGED = 1, //CG or Newton stopped at the iteration limit, heads are the last iterate
+	SOLVE_SINGULAR = 2, //the network matrix or the Newton Jacobian has a zero pivot, heads are not set
+	SOLVE_UNSUPPORTED = 3 //the call needs the LAMINAR head loss model, nothing was solved
 };
 
 //CLASS PIPENETWORK
 class pipenet
 {
 private:
-	node** vec_nodes;
-	tube** vec_tubes;
-	int n_nodes;
-	int n_tubes;
+	netcore net;
+	int precond; //preconditioner of the CG solve: 0 none, 1 Jacobi, 2 incomplete Cholesky,
+		//3 algebraic multigrid, set up once and kept between solves
+	double tol; //relative residual at which CG stops
+	int maxiter; //max number of CG iterations, 0 means 10*n_nodes
+	int iterations; //iterations taken by the last solve
+	double residual; //relative residual reached by the last solve
+	bool solved; //heads of the nodes and flows of the tubes are set
+	int lossmodel; //head loss model, see headloss.h
+	double roughness; //Hazen-Williams C or Darcy-Weisbach wall roughness of all tubes
+	double newton_htol; //Newton stops when the head update is below htol*max|h|
+	double newton_qtol; //and the flow imbalance is below qtol*max|Q|
+	int newton_maxiter;
+	int ordering; //fill-reducing ordering of the direct factors, see ordering.h
+	int subdomains; //factorize() splits the network in this many parts, 1: one factorization
+	SparseMtx* GlobalB; //system matrix with boundary conditions, kept by factorize()
+	SparseLDL* factor; //its L D L^T factors, NULL until factorize() is called
+	SchurSolver* schur; //or its subdomain factors when subdomains > 1
+	bool mixed; //factors in single precision, direct solves refined in double
+	vector<int> updtube; //tubes whose B changed since factorize(), a low-rank update of it
+	vector<double> updB; //their B at factorize()
+	vector<double> updW; //factored matrix solved with each tube's incidence vector, n_nodes each
+	vector<int> comp; //connected component of every node, from findcomponents()
+	int n_comp; //number of components
+	vector<int> islands; //nodes given a reference head because their component had no fixed head
+	SparseMtx* jacobian; //Newton Jacobian, pattern kept between solves
+	SparseLDL* jacfactor; //its factors, symbolic part reused
+	vector<int> jacpos; //positions of the 4 entries of every tube in jacobian
+	SparseMtx* amgB; //network matrix of the multigrid preconditioner
+	AMGPrecond* amg; //its levels, NULL until a solve with precond 3
+	bool amgstale; //tubes changed since the levels were built, their values are redone
+	int status; //solvestatus of the last factorize() or solve
+	string message; //what went wrong, empty if nothing did
+	ostream* logstream; //messages are written here as well, NULL: kept quiet
+	solvestats* stats; //phase timings and solver metrics go here, NULL: none are taken
+	void assembleQ(const double*,double*,int) const; //right side -Q with boundary conditions
+	void dropfactors(); //after the boundary condition pattern changed
+	void findcomponents(); //components, and a reference head for every floating island
+	SparseLDL* factorwithorder(const SparseMtx&); //symbolic and numeric factors in the set ordering
+	int singularnode(const SparseLDL*); //node (0-based) of a zero pivot
+	void tubechanged(int,double); //tube, its previous B: adds it to the low-rank update
+	bool factorsolve(double*,int); //factors and update applied to right sides, false if singular
+	bool directsolve(double*,int,int&); //factorsolve() and refinement sweeps when mixed, sweeps out
+	void multiply(const double*,double*,int) const; //factored matrix and tube changes times right sides
+	bool lowrank(int,const int*,const double*,const double* const*,double*,int) const; //Woodbury step
+	void newtonsolve(); //heads and flows for a nonlinear head loss model
+	double condition(); //1-norm condition estimate of the factored matrix
+	bool adjoint(const double*,double*,string&); //gradient of w.head over the diameters at the solved heads
+	void countsolve(); //iterations and residual of a finished solve into stats
+	void report(int,const string&); //status and message, the message to logstream
 public:	
-	pipenet(ifstream&);
+	pipenet(ifstream&,solvestats* = NULL); //stats, if given, times the parse and geometry; the text is
+		//checked as readnetwork() does, MatVecError names the line of an error
+	pipenet(const netdata&,solvestats* = NULL); //from readnetwork() in netio.h; MatVecError for arrays
+		//that do not match the counts or tubes to nodes out of range
+	pipenet(const netsnapshot&); //from a binary snapshot, see netio.h; the arrays are copied,
+		//the snapshot can be closed afterwards. throws MatVecError if it is not valid
+	bool savesnapshot(const char*,bool,string&); //file, store heads, error message
 	//void Display();
 	//void test();
-	void calcflowrate();
+	void setsolver(int,double,int); //preconditioner, tolerance, max iterations
+	void setheadloss(int,double); //model, roughness; LAMINAR is the linear solve
+	void setnewton(double,double,int); //head tolerance, flow tolerance, max iterations
+	void setordering(int); //ORDER_NATURAL, ORDER_RCM or ORDER_AMD for the direct factors
+	void setsubdomains(int); //parts factored in parallel by factorize(), 1 for none
+	void setmixedprecision(bool); //single precision factors refined to tol in double
+	void settelemetry(solvestats* s) { stats = s; } //see telemetry.h, NULL turns it off
+	void setlog(ostream* s) { logstream = s; } //where messages go as well, NULL (none) by default
+	int getheadloss() const { return lossmodel; }
+	int getstatus() const { return status; } //SOLVE_OK, or solvestatus of what went wrong
+	const string& getmessage() const { return message; } //its description, empty for SOLVE_OK
+	int getiterations();
+	double getresidual();
+	void factorize(); //factors the network matrix once for later solves
+	void solvescenarios(int,const double*,double*); //heads for many demand vectors, LAMINAR only
+	void setfixedhead(int,double); //node (0-based), head: tanks and reservoirs
+	void setdemands(const double*); //new Q of every node
+	//tube edits throw MatVecError for a tube or node out of range, a diameter that is not
+	//positive, or a new tube of zero length
+	void settubediameter(int,double); //tube (0-based), diameter; factors are updated, not redone
+	void removetube(int); //closes a tube: it keeps its number and carries no flow
+	int addtube(int,int,double); //end nodes (0-based), diameter; returns the new tube number
+	SparseMtx assemble() const; //system matrix with boundary conditions
+	bool isfactorized() const { return factor != NULL || schur != NULL; }
+	int getcomponents() const { return n_comp; } //connected parts found by the last solve or factorize()
+	const vector<int>& getislands() const { return islands; } //reference node of each floating island
+	void outagebase(vector<double>&) const; //factored matrix solved with the right side, for solveoutage()
+	bool solveoutage(const int*,int,const double*,double*,vector<double>&) const; //tubes, count,
+		//outagebase() or NULL, heads out, scratch: heads with the tubes closed, network untouched.
+		//needs factorize() and the laminar model; safe to call from several threads
+	void solve(); //heads and flows, starting from the last heads once solved
+	bool headgradient(const double*,double*,string&); //node weights w, gradient out: d(sum of w_i head_i)/d dia_t
+		//of every tube, from one adjoint solve with the factors. solves first; laminar model only
+	bool minheadgradient(double*,int&,string&); //gradient of the lowest free head, its node (0-based) out
+	string calcflowrate(); //solve(), then the flows as text, one line per tube
+	bool saveresults(const char*,string&); //binary columnar heads and flows, see netio.h; solves first if needed,
+		//false with the solver's message if that solve fails
+	bool savecsv(const char*,const char*,string&); //node and tube CSV tables, either file may be NULL; solves
+		//first as saveresults does
+	const netcore& getcore() const { return net; }
 	~pipenet();
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+//Contingency analysis
+#include "contingency.h"
+#include "headloss.h"
+#include "threadpool.h"
+
+contingency::contingency(pipenet& network, double minhead)
+	:net(network),hmin(minhead)
+{
+}
+
+void contingency::addoutage(const vector<int>& tubes)
+{
+	outages.push_back(tubes);
+}
+
+void contingency::addsingleoutages()
+{
+	int n_tubes = net.getcore().n_tubes;
+	for (int t = 0; t < n_tubes; t++)
+		outages.push_back(vector<int>(1, t));
+}
+
+bool contingency::run(vector<outageresult>& results, string& err)
+{// every outage is a low-rank update of the base factors (see pipenet::solveoutage),
+	// the threads share the factors and keep their own heads and update columns
+	if (net.getheadloss() != LAMINAR)
+	{
+		err = "contingency analysis needs the laminar head loss model";
+		return false;
+	}
+	const netcore& c = net.getcore();
+	for (size_t s = 0; s < outages.size(); s++)
+		for (size_t o = 0; o < outages[s].size(); o++)
+			if (outages[s][o] < 0 || outages[s][o] >= c.n_tubes)
+			{
+				err = "outage " + to_string(s + 1) + ": no tube " + to_string(outages[s][o] + 1);
+				return false;
+			}
+	if (!net.isfactorized())
+		net.factorize();
+	if (net.getstatus() == SOLVE_SINGULAR)
+	{// no base factors to update
+		err = net.getmessage();
+		return false;
+	}
+	vector<double> y0;
+	net.outagebase(y0);
+
+	threadpool& pool = threadpool::shared();
+	vector<vector<double> > heads(pool.size()), work(pool.size());
+	results.assign(outages.size(), outageresult());
+	pool.parallel_for((int)outages.size(), [&](int s, int slot) {
+		const vector<int>& out = outages[s];
+		vector<double>& h = heads[slot];
+		h.resize(c.n_nodes);
+		outageresult& r = results[s];
+		r.tubes = out;
+		r.minhead = 0.0;
+		r.minnode = -1;
+		r.connected = net.solveoutage(out.data(), (int)out.size(), y0.data(), h.data(), work[slot]);
+		if (!r.connected)
+			return;
+		for (int i = 0; i < c.n_nodes; i++)
+		{
+			if (c.fixed[i]) continue;
+			if (r.minnode < 0 || h[i] < r.minhead)
+			{
+				r.minhead = h[i];
+				r.minnode = i;
+			}
+			if (h[i] < hmin) r.violations.push_back(i);
+		}
+	});
+	return true;
+}
+
+void contingency::report(ostream& out, const vector<outageresult>& results) const
+{
+	for (size_t s = 0; s < results.size(); s++)
+	{
+		const outageresult& r = results[s];
+		if (r.connected && r.violations.empty()) continue;
+		out << "Outage of tube";
+		for (size_t o = 0; o < r.tubes.size(); o++) out << " " << r.tubes[o] + 1;
+		if (!r.connected)
+		{
+			out << "--  network split\n";
+			continue;
+		}
+		out << "--  " << r.violations.size() << " nodes below " << hmin << ", lowest head " << r.minhead << " at node " << r.minnode + 1 << "\n";
+	}
+}
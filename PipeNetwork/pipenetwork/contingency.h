@@ -0,0 +1,37 @@
+/*
+	contingency.h
+	Contingency analysis: the network with sets of tubes out of service, solved
+	in parallel from one factorization
+*/
+#ifndef CONTINGENCY_H_
+#define CONTINGENCY_H_
+#include <ostream>
+#include <string>
+#include <vector>
+#include "classes.h"
+
+struct outageresult
+{
+	vector<int> tubes; //tubes out of service, 0-based
+	bool connected; //false if the outage cuts nodes off every fixed head
+	double minhead; //lowest head of a free node
+	int minnode; //its number, 0-based
+	vector<int> violations; //free nodes below the minimum head, 0-based
+};
+
+//CLASS CONTINGENCY
+class contingency
+{
+private:
+	pipenet& net; //base network, only read while the outages run
+	double hmin; //minimum head a node must keep
+	vector<vector<int> > outages;
+public:
+	contingency(pipenet&,double); //base network, minimum head
+	void addoutage(const vector<int>&); //tubes (0-based) out of service together
+	void addsingleoutages(); //every N-1 outage, one per tube
+	int size() const { return (int)outages.size(); }
+	bool run(vector<outageresult>&,string&); //results in the order of the outages, error message
+	void report(ostream&,const vector<outageresult>&) const; //prints the outages with violations
+};
+#endif
@@ -0,0 +1,140 @@
+//Extended period simulation
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include "extperiod.h"
+#include "headloss.h"
+#include "MatVec.h"
+
+extperiod::extperiod(pipenet& network, double step, double pstep)
+	:net(network),dt(step),patternstep(pstep)
+{
+	if (!(dt > 0) || !(patternstep > 0))
+		throw MatVecError("extperiod: the time step and the pattern step must be positive");
+	const netcore& c = net.getcore();
+	baseQ = c.Q;
+	nodepattern.assign(c.n_nodes, -1);
+}
+
+int extperiod::addpattern(const vector<double>& factors)
+{
+	patterns.push_back(factors);
+	return (int)patterns.size() - 1;
+}
+
+void extperiod::setpattern(int node, int pattern)
+{
+	if (node < 0 || node >= (int)nodepattern.size())
+		throw MatVecError(("extperiod::setpattern: no node " + to_string(node)).c_str());
+	if (pattern < -1 || pattern >= (int)patterns.size())
+		throw MatVecError(("extperiod::setpattern: no pattern " + to_string(pattern)).c_str());
+	nodepattern[node] = pattern;
+}
+
+void extperiod::addtank(int node, double elevation, double level, double area, double minlevel, double maxlevel)
+{
+	if (node < 0 || node >= (int)nodepattern.size())
+		throw MatVecError(("extperiod::addtank: no node " + to_string(node)).c_str());
+	if (!(area > 0) || !(minlevel <= maxlevel))
+		throw MatVecError("extperiod::addtank: the area must be positive and minlevel not above maxlevel");
+	tank t;
+	t.node = node;
+	t.elevation = elevation;
+	t.level = level;
+	t.area = area;
+	t.minlevel = minlevel;
+	t.maxlevel = maxlevel;
+	const netcore& c = net.getcore();
+	for (int i = 0; i < c.n_tubes; i++)
+		if (c.n1[i] == node || c.n2[i] == node) t.tubes.push_back(i);
+	tanks.push_back(t);
+	net.setfixedhead(node, elevation + level); //a tank is a fixed head during each step
+}
+
+bool extperiod::run(double duration, const char* filename, string& err)
+{// each step: demands from the patterns, tank heads from the levels, a solve that
+	// starts from the previous heads, one record to the file, then the tank levels
+	// move with their net inflow over the step. nothing but one record is kept
+	const netcore& c = net.getcore();
+	const int n = c.n_nodes;
+	const int nt = c.n_tubes;
+	const int nk = (int)tanks.size();
+	const long nsteps = (long)floor(duration / dt + 0.5) + 1; //t = 0, dt, ..., duration
+
+	FILE* out = fopen(filename, "wb");
+	if (!out)
+	{
+		err = string(filename) + ": cannot write file";
+		return false;
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+	epsheader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, EPS_MAGIC, sizeof(EPS_MAGIC));
+	h.version = EPS_VERSION;
+	h.n_nodes = n;
+	h.n_tubes = nt;
+	h.n_tanks = nk;
+	h.n_steps = nsteps;
+	h.dt = dt;
+	bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+
+	for (int k = 0; k < nk; k++) //before the first factorization, so it sees all tanks
+		net.setfixedhead(tanks[k].node, tanks[k].elevation + tanks[k].level);
+	if (net.getheadloss() == LAMINAR)
+		net.factorize(); //one factorization, every step is a pair of triangular solves
+
+	vector<double> Q(n);
+	vector<double> record(1 + n + nt + nk);
+	for (long s = 0; ok && s < nsteps; s++)
+	{
+		double t = s * dt;
+		long pstep = (long)floor(t / patternstep);
+		for (int i = 0; i < n; i++)
+		{
+			int p = nodepattern[i];
+			Q[i] = (p < 0 || patterns[p].empty()) ? baseQ[i] : baseQ[i] * patterns[p][pstep % patterns[p].size()];
+		}
+		net.setdemands(Q.data());
+		for (int k = 0; k < nk; k++)
+			net.setfixedhead(tanks[k].node, tanks[k].elevation + tanks[k].level);
+		net.solve();
+		if (net.getstatus() != SOLVE_OK)
+		{// the heads of this step are no result, and the tanks cannot move on from them
+			fclose(out);
+			ostringstream m;
+			m << "step at t = " << t << " s: " << net.getmessage();
+			err = m.str();
+			return false;
+		}
+
+		record[0] = t;
+		memcpy(&record[1], c.head.data(), n * sizeof(double));
+		memcpy(&record[1 + n], c.q.data(), nt * sizeof(double));
+		for (int k = 0; k < nk; k++) record[1 + n + nt + k] = tanks[k].level;
+		ok = fwrite(record.data(), sizeof(double), record.size(), out) == record.size();
+
+		for (int k = 0; k < nk; k++) //inflow = flow arriving through the tubes minus the demand
+		{
+			tank& tk = tanks[k];
+			double inflow = -Q[tk.node];
+			for (size_t j = 0; j < tk.tubes.size(); j++)
+			{
+				int i = tk.tubes[j];
+				inflow += (c.n2[i] == tk.node) ? c.q[i] : -c.q[i];
+			}
+			tk.level += inflow * dt / tk.area;
+			if (tk.level > tk.maxlevel) tk.level = tk.maxlevel; //full or empty: held at the limit
+			if (tk.level < tk.minlevel) tk.level = tk.minlevel;
+		}
+	}
+	if (fclose(out) != 0) ok = false;
+	if (!ok)
+	{
+		err = string(filename) + ": write failed";
+		return false;
+	}
+	err.clear();
+	return true;
+}
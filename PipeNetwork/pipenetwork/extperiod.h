@@ -0,0 +1,58 @@
+/*
+	extperiod.h
+	Extended period simulation: a sequence of steady states with time varying
+	demands and tank levels
+*/
+#ifndef EXTPERIOD_H_
+#define EXTPERIOD_H_
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "classes.h"
+
+//results file of extperiod::run(): this header, then one record per step of
+//1 + n_nodes + n_tubes + n_tanks doubles: time, heads, tube flows, tank levels
+const char EPS_MAGIC[8] = {'P','N','E','T','E','P','S','\0'};
+const uint32_t EPS_VERSION = 1;
+
+struct epsheader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	int64_t n_nodes;
+	int64_t n_tubes;
+	int64_t n_tanks;
+	int64_t n_steps; //records that follow
+	double dt; //hydraulic time step, s
+};
+
+//CLASS EXTPERIOD
+class extperiod
+{
+private:
+	struct tank
+	{
+		int node; //0-based
+		double elevation; //head = elevation + level
+		double level, area, minlevel, maxlevel;
+		vector<int> tubes; //tubes that end at the tank
+	};
+	pipenet& net;
+	double dt; //hydraulic time step, s
+	double patternstep; //time one pattern factor holds, s
+	vector<double> baseQ; //demands the patterns multiply
+	vector<vector<double> > patterns; //demand factors, repeated over time
+	vector<int> nodepattern; //pattern of each node, -1: constant demand
+	vector<tank> tanks;
+public:
+	//the calls below throw MatVecError for arguments out of range
+	extperiod(pipenet&,double,double); //network, time step, pattern step (s), both positive
+	int addpattern(const vector<double>&); //returns the pattern number
+	void setpattern(int,int); //node (0-based), pattern from addpattern() or -1 for constant demand
+	void addtank(int,double,double,double,double,double); //node, elevation, level, area, min and max level
+	double gettanklevel(int k) const { return tanks[k].level; }
+	bool run(double,const char*,string&); //duration (s), results file, error message; false if a step
+		//cannot be written or its solve fails, the file then ends with the last good step
+};
+#endif
@@ -0,0 +1,53 @@
+//Flow laws of a tube
+#include <cmath>
+#include "headloss.h"
+
+namespace
+{
+const double GRAVITY = 9.81;
+const double VISCOSITY = 1.0e-6; //kinematic, water
+
+//Hazen-Williams: dh = 10.67 L q^1.852 / (C^1.852 D^4.87), solved for q >= 0
+double hazenwilliams(double dh, double dia, double length, double C, double& dqdh)
+{
+	const double e = 1.0 / 1.852;
+	double q = C * pow(dh * pow(dia, 4.87) / (10.67 * length), e);
+	dqdh = e * q / dh;
+	return q;
+}
+
+//Darcy-Weisbach with the explicit Swamee-Jain discharge equation, for q >= 0:
+//q = -0.965 D^2 a ln(k + c/a), a = sqrt(g D dh/L), k = eps/(3.7 D), c = 1.784 nu/D
+double darcyweisbach(double dh, double dia, double length, double eps, double& dqdh)
+{
+	double a = sqrt(GRAVITY * dia * dh / length);
+	double k = eps / (3.7 * dia);
+	double c = 1.784 * VISCOSITY / dia;
+	double arg = k + c / a;
+	double q = -0.965 * dia * dia * a * log(arg);
+	double dadh = 0.5 * a / dh;
+	dqdh = -0.965 * dia * dia * dadh * (log(arg) - (c / a) / arg);
+	return q;
+}
+}
+
+double tubeflow(int model, double dh, double dia, double length, double B, double roughness, double& dqdh)
+{
+	double s = (dh < 0) ? -1.0 : 1.0; //the laws are odd in dh
+	double adh = fabs(dh);
+	double ql = B * adh; //laminar flow, the cap
+	dqdh = B;
+	if (model == LAMINAR || adh == 0.0)
+		return s * ql;
+
+	double dt;
+	double qt = (model == HAZEN_WILLIAMS)
+		? hazenwilliams(adh, dia, length, roughness, dt)
+		: darcyweisbach(adh, dia, length, roughness, dt);
+	if (qt < ql && qt > 0.0)
+	{
+		dqdh = dt;
+		return s * qt;
+	}
+	return s * ql;
+}
@@ -0,0 +1,21 @@
+/*
+	headloss.h
+	Flow laws of a tube: flow as a function of the head difference
+*/
+#ifndef HEADLOSS_H_
+#define HEADLOSS_H_
+
+//head loss models of pipenet::setheadloss()
+enum headlossmodel
+{
+	LAMINAR = 0, //q = B dh, the linear model of netcore::calcB
+	HAZEN_WILLIAMS = 1, //roughness is the Hazen-Williams coefficient C
+	DARCY_WEISBACH = 2 //roughness is the absolute wall roughness in m, Swamee-Jain friction
+};
+
+//flow through a tube for the head difference dh = h1 - h2 (SI units, kinematic
+//viscosity 1e-6 m2/s as in conductance() in classes.h), dqdh gets its derivative.
+//B is the laminar conductance of the tube; the turbulent laws are capped by it,
+//so the flow and its derivative stay finite at dh = 0
+double tubeflow(int model, double dh, double dia, double length, double B, double roughness, double& dqdh);
+#endif
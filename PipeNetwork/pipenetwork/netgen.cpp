@@ -0,0 +1,370 @@
+//Synthetic networks of any size
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_set>
+#include <vector>
+#include "netgen.h"
+
+using namespace std;
+
+namespace
+{
+//commercial pipe sizes, m
+const double DIAMETERS[] = {0.05, 0.065, 0.08, 0.1, 0.125, 0.15, 0.2, 0.25, 0.3, 0.35,
+	0.4, 0.45, 0.5, 0.6, 0.7, 0.8, 0.9, 1.0, 1.2};
+const double PI = 3.14159265358979323846;
+const int TREE_WINDOW = 16; //a tree node hangs from one of the 16 nodes before it
+const double LOOP_REACH = 2.0; //loop tubes are at most this many spacings long
+const double SHORTEST = 0.25; //spacings: no tube is shorter, no random node closer to another
+const int PLACE_TRIES = 30; //random points drawn before one is taken closer than that
+const double ISLAND_GAP = 5.0; //spacings between two islands
+const double DEMAND_UNIT = 1.0 / 1024; //demands are multiples, so their sums are exact
+
+//splitmix64. the distributions of <random> differ between standard libraries, this
+//and the arithmetic below do not (only sqrt is used, and it is exactly rounded)
+class netrandom
+{
+private:
+	uint64_t s;
+public:
+	netrandom(uint64_t seed) : s(seed) {}
+	uint64_t next()
+	{
+		uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+	double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); } //[0,1)
+	int below(int n) { return (int)(uniform() * n); } //[0,n)
+};
+
+inline double cm(double v) { return floor(v * 100.0 + 0.5) / 100.0; }
+
+inline double distance2(const netdata& net, int a, int b)
+{
+	double dx = net.x[a] - net.x[b], dy = net.y[a] - net.y[b];
+	return dx * dx + dy * dy;
+}
+
+inline void addtube(netdata& net, int a, int b)
+{
+	net.n1.push_back(a);
+	net.n2.push_back(b);
+}
+
+//nodes lo..hi-1 binned into square cells
+class cellgrid
+{
+private:
+	const netdata& net;
+	double x0, y0, size;
+	int nx, ny;
+	vector<int> start, item; //nodes of cell c: item[start[c]..start[c+1])
+public:
+	cellgrid(const netdata& net, int lo, int hi, double cellsize) : net(net), size(cellsize)
+	{
+		double x1, y1;
+		x0 = x1 = net.x[lo];
+		y0 = y1 = net.y[lo];
+		for (int i = lo; i < hi; i++)
+		{
+			x0 = min(x0, net.x[i]); x1 = max(x1, net.x[i]);
+			y0 = min(y0, net.y[i]); y1 = max(y1, net.y[i]);
+		}
+		// no more than about 4 cells a node, however stretched the nodes are
+		double cells = ((x1 - x0) / size + 1) * ((y1 - y0) / size + 1);
+		if (cells > 4.0 * (hi - lo)) size *= sqrt(cells / (4.0 * (hi - lo)));
+		nx = (int)((x1 - x0) / size) + 1;
+		ny = (int)((y1 - y0) / size) + 1;
+		start.assign((size_t)nx * ny + 1, 0);
+		item.resize(hi - lo);
+		for (int i = lo; i < hi; i++) start[cell(i) + 1]++;
+		for (size_t c = 0; c + 1 < start.size(); c++) start[c + 1] += start[c];
+		vector<int> next(start.begin(), start.end() - 1);
+		for (int i = lo; i < hi; i++) item[next[cell(i)]++] = i;
+	}
+	int cellx(int i) const { return min((int)((net.x[i] - x0) / size), nx - 1); }
+	int celly(int i) const { return min((int)((net.y[i] - y0) / size), ny - 1); }
+	int cell(int i) const { return celly(i) * nx + cellx(i); }
+
+	//calls f(j) for every node j in the cells around that of i, i itself included
+	template<class F> void neighbours(int i, F f) const
+	{
+		int cx = cellx(i), cy = celly(i);
+		for (int y = max(cy - 1, 0); y <= min(cy + 1, ny - 1); y++)
+			for (int x = max(cx - 1, 0); x <= min(cx + 1, nx - 1); x++)
+				for (int k = start[y * nx + x]; k < start[y * nx + x + 1]; k++) f(item[k]);
+	}
+
+	//the node nearest to i, at a distance in [least, reach], for which ok(j) holds; -1 if
+	//none. searches rings of cells outwards until no closer node can follow
+	template<class F> int nearest(int i, double least, double reach, F ok) const
+	{
+		int cx = cellx(i), cy = celly(i);
+		int best = -1;
+		double bestd = reach * reach;
+		for (int r = 0; r <= max(nx, ny); r++)
+		{
+			double gap = (r - 1) * size; //least distance to a node of ring r
+			if (r > 0 && gap * gap > bestd) break;
+			for (int y = cy - r; y <= cy + r; y++)
+			{
+				if (y < 0 || y >= ny) continue;
+				int step = (y == cy - r || y == cy + r) ? 1 : 2 * r; //inside: the two ends only
+				for (int x = cx - r; x <= cx + r; x += max(step, 1))
+				{
+					if (x < 0 || x >= nx) continue;
+					for (int k = start[y * nx + x]; k < start[y * nx + x + 1]; k++)
+					{
+						int j = item[k];
+						double d = distance2(net, i, j);
+						if (d > 0.0 && d >= least * least && d <= bestd && (best < 0 || d < bestd) && ok(j)) { best = j; bestd = d; }
+					}
+				}
+			}
+		}
+		return best;
+	}
+};
+
+//union-find over the nodes of one part
+class unionfind
+{
+private:
+	vector<int> up;
+	int lo;
+public:
+	unionfind(int lo, int hi) : up(hi - lo), lo(lo) { iota(up.begin(), up.end(), 0); }
+	int find(int i)
+	{
+		i -= lo;
+		while (up[i] != i) i = up[i] = up[up[i]];
+		return i;
+	}
+	bool unite(int a, int b)
+	{
+		a = find(a); b = find(b);
+		if (a == b) return false;
+		up[max(a, b)] = min(a, b);
+		return true;
+	}
+};
+
+//side x side grid, the last row may be short
+void makegrid(netdata& net, int n, double spacing)
+{
+	int side = (int)ceil(sqrt((double)n));
+	while (side * side < n) side++;
+	while ((side - 1) * (side - 1) >= n) side--;
+	for (int i = 0; i < n; i++)
+	{
+		net.x.push_back((i % side) * spacing);
+		net.y.push_back((i / side) * spacing);
+	}
+	for (int i = 0; i < n; i++)
+	{
+		if (i % side + 1 < side && i + 1 < n) addtube(net, i, i + 1);
+		if (i + side < n) addtube(net, i, i + side);
+	}
+}
+
+//n random points from x0 on, one a spacing^2 on average and none closer than SHORTEST to
+//another, a tube between any two within the radius that gives the mean degree; the parts
+//left over are joined to their nearest node outside them
+void makegeometric(netdata& net, int n, double x0, const netgenoptions& opt, netrandom& rnd)
+{
+	int lo = (int)net.x.size(), hi = lo + n;
+	int cellside = (int)ceil(sqrt((double)n));
+	double side = opt.spacing * cellside;
+	double least = SHORTEST * opt.spacing;
+	vector<int> first((size_t)cellside * cellside, -1), next(n); //points of each spacing^2 cell, as lists
+	for (int i = lo; i < hi; i++)
+	{
+		double x = 0.0, y = 0.0;
+		int cx = 0, cy = 0;
+		for (int tries = 0; tries < PLACE_TRIES; tries++)
+		{
+			x = cm(rnd.uniform() * side);
+			y = cm(rnd.uniform() * side);
+			cx = min((int)(x / opt.spacing), cellside - 1);
+			cy = min((int)(y / opt.spacing), cellside - 1);
+			bool free = true;
+			for (int v = max(cy - 1, 0); free && v <= min(cy + 1, cellside - 1); v++)
+				for (int u = max(cx - 1, 0); free && u <= min(cx + 1, cellside - 1); u++)
+					for (int j = first[v * cellside + u]; free && j >= 0; j = next[j - lo])
+					{
+						double dx = net.x[j] - x0 - x, dy = net.y[j] - y;
+						free = dx * dx + dy * dy >= least * least;
+					}
+			if (free) break;
+		}
+		net.x.push_back(x0 + x);
+		net.y.push_back(y);
+		next[i - lo] = first[cy * cellside + cx];
+		first[cy * cellside + cx] = i;
+	}
+	double radius = opt.spacing * sqrt(opt.degree / PI);
+	cellgrid cells(net, lo, hi, radius);
+	unionfind parts(lo, hi);
+	for (int i = lo; i < hi; i++)
+		cells.neighbours(i, [&](int j) {
+			double d = distance2(net, i, j);
+			if (j > i && d >= least * least && d <= radius * radius)
+			{
+				addtube(net, i, j);
+				parts.unite(i, j);
+			}
+		});
+	double reach = 2.0 * radius;
+	for (bool joined = n < 2; !joined; reach *= 2.0)
+	{// links no longer than reach from every node not yet connected to the first one,
+		// reach doubles until none is left
+		for (int i = lo; i < hi; i++)
+		{
+			if (parts.find(i) == parts.find(lo)) continue;
+			int j = cells.nearest(i, least, reach, [&](int j) { return parts.find(j) != parts.find(i); });
+			if (j < 0) continue;
+			addtube(net, i, j);
+			parts.unite(i, j);
+		}
+		joined = true;
+		for (int i = lo; i < hi && joined; i++) joined = parts.find(i) == parts.find(lo);
+		if (reach > 4.0 * side) break; //every other node is too close to one left over
+	}
+}
+
+//every node hangs one spacing away from one of the few nodes before it, heading on from
+//its parent's direction; then loops*n tubes join nodes to near ones they have no tube to
+void maketree(netdata& net, int n, const netgenoptions& opt, netrandom& rnd)
+{
+	vector<double> ux(n), uy(n); //direction of each node from its parent
+	unordered_set<uint64_t> joined; //tubes, as lower node * 2^32 + higher node
+	auto key = [](int a, int b) { return (uint64_t)min(a, b) << 32 | (uint64_t)max(a, b); };
+	net.x.push_back(0.0);
+	net.y.push_back(0.0);
+	ux[0] = 1.0; uy[0] = 0.0;
+	for (int i = 1; i < n; i++)
+	{
+		int p = i - 1 - rnd.below(min(i, TREE_WINDOW));
+		double dx = ux[p] + 2.0 * rnd.uniform() - 1.0;
+		double dy = uy[p] + 2.0 * rnd.uniform() - 1.0;
+		double len = sqrt(dx * dx + dy * dy);
+		if (len < 1e-3) { dx = ux[p]; dy = uy[p]; len = 1.0; }
+		ux[i] = dx / len; uy[i] = dy / len;
+		net.x.push_back(cm(net.x[p] + opt.spacing * ux[i]));
+		net.y.push_back(cm(net.y[p] + opt.spacing * uy[i]));
+		addtube(net, p, i);
+		joined.insert(key(p, i));
+	}
+	int loops = (int)(opt.loops * n + 0.5);
+	if (loops == 0 || n < 3) return;
+	cellgrid cells(net, 0, n, opt.spacing);
+	for (int tries = 0; loops > 0 && tries < 4 * (int)(opt.loops * n + 0.5); tries++)
+	{
+		int i = rnd.below(n);
+		int j = cells.nearest(i, SHORTEST * opt.spacing, LOOP_REACH * opt.spacing, [&](int j) { return joined.count(key(i, j)) == 0; });
+		if (j < 0) continue;
+		addtube(net, i, j);
+		joined.insert(key(i, j));
+		loops--;
+	}
+}
+
+//demands of nodes lo..hi-1, the sources (lo and a random choice of the others) supply them
+void makedemands(netdata& net, int lo, int hi, const netgenoptions& opt, netrandom& rnd)
+{
+	int n = hi - lo;
+	int sources = opt.sources > 0 ? opt.sources : max(1, n / 1000);
+	sources = min(sources, max(n - 1, 1));
+	vector<int> source(1, lo);
+	vector<char> chosen(n, 0);
+	chosen[0] = 1;
+	while ((int)source.size() < sources)
+	{
+		int i = 1 + rnd.below(n - 1);
+		if (!chosen[i]) { chosen[i] = 1; source.push_back(lo + i); }
+	}
+	double units = floor(2.0 * opt.demand / DEMAND_UNIT + 0.5); //largest demand in units
+	double total = 0.0;
+	for (int i = 0; i < n; i++)
+	{
+		net.Q[lo + i] = chosen[i] ? 0.0 : floor(rnd.uniform() * (units + 1)) * DEMAND_UNIT;
+		total += net.Q[lo + i];
+	}
+	double share = floor(total / sources / DEMAND_UNIT) * DEMAND_UNIT;
+	for (int k = 0; k + 1 < sources; k++) net.Q[source[k]] = -share;
+	net.Q[source.back()] = -(total - share * (sources - 1));
+}
+}
+
+bool generatenetwork(const netgenoptions& opt, netdata& net, string& err)
+{
+	if (opt.nodes < 1) { err = "netgen: the network needs at least one node"; return false; }
+	if (!(opt.spacing > 0.0)) { err = "netgen: spacing must be positive"; return false; }
+	if (!(opt.demand >= 0.0)) { err = "netgen: demand must not be negative"; return false; }
+	if (!(opt.degree > 0.0)) { err = "netgen: degree must be positive"; return false; }
+	if (!(opt.loops >= 0.0)) { err = "netgen: loops must not be negative"; return false; }
+	if (opt.sources < 0) { err = "netgen: sources must not be negative"; return false; }
+	int islands = (opt.topology == NET_ISLANDS) ? opt.islands : 1;
+	if (islands < 1 || islands > opt.nodes) { err = "netgen: islands must be between 1 and the node count"; return false; }
+	vector<double> sizes;
+	for (double d : DIAMETERS)
+		if (d >= opt.mindia && d <= opt.maxdia) sizes.push_back(d);
+	if (sizes.empty()) { err = "netgen: no standard diameter between mindia and maxdia"; return false; }
+
+	netrandom rnd(opt.seed);
+	net = netdata();
+	net.x.reserve(opt.nodes); net.y.reserve(opt.nodes);
+	vector<int> parts(1, 0); //first node of each part, and the node count
+	switch (opt.topology)
+	{
+	case NET_GRID:
+		makegrid(net, opt.nodes, opt.spacing);
+		break;
+	case NET_GEOMETRIC:
+		makegeometric(net, opt.nodes, 0.0, opt, rnd);
+		break;
+	case NET_TREE:
+		maketree(net, opt.nodes, opt, rnd);
+		break;
+	case NET_ISLANDS:
+	{
+		double x0 = 0.0;
+		for (int k = 0; k < islands; k++)
+		{
+			int n = opt.nodes / islands + (k < opt.nodes % islands ? 1 : 0);
+			makegeometric(net, n, x0, opt, rnd);
+			parts.push_back((int)net.x.size());
+			x0 += opt.spacing * (sqrt((double)n) + ISLAND_GAP);
+		}
+		parts.pop_back();
+		break;
+	}
+	}
+	parts.push_back(opt.nodes);
+	net.n_nodes = opt.nodes;
+	net.n_tubes = (int)net.n1.size();
+	net.Q.resize(opt.nodes);
+	for (size_t k = 0; k + 1 < parts.size(); k++)
+		makedemands(net, parts[k], parts[k + 1], opt, rnd);
+	net.dia.resize(net.n_tubes);
+	for (int t = 0; t < net.n_tubes; t++)
+		net.dia[t] = sizes[rnd.below((int)sizes.size())];
+	err.clear();
+	return true;
+}
+
+bool parsetopology(const char* name, nettopology& topology)
+{
+	static const char* const names[] = {"grid", "geometric", "tree", "islands"};
+	for (int k = 0; k < 4; k++)
+		if (strcmp(name, names[k]) == 0)
+		{
+			topology = (nettopology)k;
+			return true;
+		}
+	return false;
+}
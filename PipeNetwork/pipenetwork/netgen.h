@@ -0,0 +1,42 @@
+/*
+	netgen.h
+	Synthetic networks of any size, for scale testing and reproducible benchmarks
+*/
+#ifndef NETGEN_H_
+#define NETGEN_H_
+#include <cstdint>
+#include <string>
+#include "netio.h"
+
+enum nettopology
+{
+	NET_GRID, //rectangular grid, rows of ceil(sqrt(n)) nodes
+	NET_GEOMETRIC, //random points, a tube to every neighbour within a radius
+	NET_TREE, //random branching tree, closed into loops by short extra tubes
+	NET_ISLANDS //several geometric networks side by side, not connected to each other
+};
+
+//STRUCT NETGENOPTIONS: what generatenetwork() builds
+struct netgenoptions
+{
+	nettopology topology = NET_GRID;
+	int nodes = 1000;
+	uint64_t seed = 1; //same seed and options, same network on every platform
+	double spacing = 100.0; //distance between neighbouring nodes, m
+	double degree = 4.0; //NET_GEOMETRIC, NET_ISLANDS: mean tubes per node
+	double loops = 0.1; //NET_TREE: extra tubes per node
+	int islands = 4; //NET_ISLANDS: number of parts
+	double demand = 0.5; //mean demand, node demands are uniform in [0, 2*demand]
+	int sources = 0; //supply nodes per island, 0 for one per 1000 nodes
+	double mindia = 0.1, maxdia = 0.5; //tubes get the standard diameters in this range
+};
+
+//a network as the options say. every part is connected and its first node is a source,
+//so node 1 (the default fixed head) supplies the first one. demands are multiples of
+//1/1024 and the sources share their sum, so every part balances to exactly zero.
+//coordinates are rounded to 1 cm and no tube has zero length.
+//returns false and sets err for options out of range
+bool generatenetwork(const netgenoptions& opt, netdata& net, std::string& err);
+//"grid", "geometric", "tree" or "islands"
+bool parsetopology(const char* name, nettopology& topology);
+#endif
@@ -0,0 +1,566 @@
+//Fast loading of pipe network input files
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifdef _WIN32
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "netio.h"
+#include "telemetry.h"
+
+using namespace std;
+
+/********************************************************/
+//Functions of class mappedfile
+
+mappedfile::mappedfile(const char* filename)
+	:data(NULL),length(0),mapped(false),opened(false)
+{
+#ifdef _WIN32
+	ifstream in(filename, ios::binary);
+	if (!in)
+		return;
+	opened = true;
+	in.seekg(0, ios::end);
+	length = (size_t)in.tellg();
+	in.seekg(0, ios::beg);
+	if (length > 0)
+	{
+		char* buf = new char[length];
+		in.read(buf, length);
+		data = buf;
+	}
+#else
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		if (fd >= 0) close(fd);
+		return;
+	}
+	opened = true;
+	length = (size_t)st.st_size;
+	if (length > 0)
+	{
+		void* p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			madvise(p, length, MADV_SEQUENTIAL); //read once front to back
+			data = (const char*)p;
+			mapped = true;
+		}
+		else
+		{// e.g. a pipe: fall back to reading it
+			char* buf = new char[length];
+			size_t got = 0;
+			ssize_t r;
+			while (got < length && (r = read(fd, buf + got, length - got)) > 0) got += r;
+			length = got;
+			data = buf;
+		}
+	}
+	close(fd);
+#endif
+}
+
+mappedfile::~mappedfile()
+{
+#ifndef _WIN32
+	if (mapped)
+	{
+		munmap((void*)data, length);
+		return;
+	}
+#endif
+	delete[] data;
+}
+
+/********************************************************/
+//Parser
+
+namespace
+{
+//walks a buffer line by line, keeping the line number for messages
+struct linereader
+{
+	const char* p;
+	const char* end;
+	long line;
+	const char* lb; //current line [lb,le)
+	const char* le;
+
+	//next line that is not blank, false at the end of the buffer
+	bool next()
+	{
+		while (p < end)
+		{
+			lb = p;
+			const char* nl = (const char*)memchr(p, '\n', end - p);
+			le = nl ? nl : end;
+			p = nl ? nl + 1 : end;
+			line++;
+			for (const char* c = lb; c < le; c++)
+				if (*c != ' ' && *c != '\t' && *c != '\r') return true;
+		}
+		return false;
+	}
+};
+
+inline const char* skipblank(const char* c, const char* e)
+{
+	while (c < e && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+	return c;
+}
+
+//reads the next whitespace separated number of the line into v
+template<class T> bool field(const char*& c, const char* e, T& v)
+{
+	c = skipblank(c, e);
+	if (c < e && *c == '+') c++; //from_chars does not take a leading '+'
+	from_chars_result r = from_chars(c, e, v);
+	if (r.ec != errc() || (r.ptr < e && *r.ptr != ' ' && *r.ptr != '\t' && *r.ptr != '\r'))
+		return false;
+	c = r.ptr;
+	return true;
+}
+
+bool fail(string& err, const char* name, long line, const string& msg)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), ":%ld: ", line);
+	err = string(name) + buf + msg;
+	return false;
+}
+}
+
+bool parsenetwork(const char* begin, const char* end, const char* name, netdata& net, string& err)
+{
+	linereader in = {begin, end, 0, begin, begin};
+	const char* c;
+
+	//the counts: one number per line
+	int counts[2];
+	const char* what[2] = {"number of nodes", "number of tubes"};
+	for (int k = 0; k < 2; k++)
+	{
+		if (!in.next())
+			return fail(err, name, in.line, string("missing ") + what[k]);
+		c = in.lb;
+		if (!field(c, in.le, counts[k]) || skipblank(c, in.le) != in.le || counts[k] < 0)
+			return fail(err, name, in.line, string("expected the ") + what[k]);
+	}
+	//a record is a line of three numbers, "0 0 0" and a newline at the least, so the
+	//counts are checked against what is left before anything is allocated for them
+	if ((long long)counts[0] + counts[1] > (in.end - in.p + 1) / 6)
+		return fail(err, name, in.line, "file is too short for " + to_string(counts[0]) + " nodes and "
+			+ to_string(counts[1]) + " tubes");
+	net.n_nodes = counts[0];
+	net.n_tubes = counts[1];
+	net.x.resize(net.n_nodes);
+	net.y.resize(net.n_nodes);
+	net.Q.resize(net.n_nodes);
+	net.n1.resize(net.n_tubes);
+	net.n2.resize(net.n_tubes);
+	net.dia.resize(net.n_tubes);
+
+	for (int i = 0; i < net.n_nodes; i++) //x y Q
+	{
+		if (!in.next())
+			return fail(err, name, in.line, "file ends after " + to_string(i) + " of " + to_string(net.n_nodes) + " nodes");
+		c = in.lb;
+		if (!field(c, in.le, net.x[i]) || !field(c, in.le, net.y[i]) || !field(c, in.le, net.Q[i])
+			|| skipblank(c, in.le) != in.le)
+			return fail(err, name, in.line, "node " + to_string(i + 1) + ": expected x y Q");
+	}
+	for (int i = 0; i < net.n_tubes; i++) //node1 node2 diameter
+	{
+		if (!in.next())
+			return fail(err, name, in.line, "file ends after " + to_string(i) + " of " + to_string(net.n_tubes) + " tubes");
+		c = in.lb;
+		int a, b;
+		if (!field(c, in.le, a) || !field(c, in.le, b) || !field(c, in.le, net.dia[i])
+			|| skipblank(c, in.le) != in.le)
+			return fail(err, name, in.line, "tube " + to_string(i + 1) + ": expected node1 node2 diameter");
+		if (a < 1 || a > net.n_nodes || b < 1 || b > net.n_nodes)
+			return fail(err, name, in.line, "tube " + to_string(i + 1) + ": node number out of range 1.." + to_string(net.n_nodes));
+		if (a == b)
+			return fail(err, name, in.line, "tube " + to_string(i + 1) + ": both ends at node " + to_string(a));
+		if (!(net.dia[i] > 0))
+			return fail(err, name, in.line, "tube " + to_string(i + 1) + ": diameter must be positive");
+		net.n1[i] = a - 1;
+		net.n2[i] = b - 1;
+	}
+	if (in.next())
+		return fail(err, name, in.line, "unexpected data after the last tube");
+	err.clear();
+	return true;
+}
+
+bool readnetwork(const char* filename, netdata& net, string& err, solvestats* stats)
+{
+	phasetimer timer(stats, PHASE_PARSE);
+	mappedfile file(filename);
+	if (!file.isopen())
+	{
+		err = string(filename) + ": cannot open file";
+		return false;
+	}
+	return parsenetwork(file.begin(), file.end(), filename, net, err);
+}
+
+/********************************************************/
+//Binary snapshots
+
+netsnapshot::netsnapshot(const char* filename)
+	:file(filename),hdr(NULL)
+{
+	if (!file.isopen())
+	{
+		err = string(filename) + ": cannot open file";
+		return;
+	}
+	const snapheader* h = (const snapheader*)file.begin();
+	if (file.size() < sizeof(snapheader) || memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+	{
+		err = string(filename) + ": not a pipe network snapshot";
+		return;
+	}
+	if (h->byteorder != SNAPSHOT_BYTEORDER)
+	{
+		err = string(filename) + ": snapshot was written on a machine of the other byte order";
+		return;
+	}
+	if (h->version != SNAPSHOT_VERSION)
+	{
+		err = string(filename) + ": snapshot version " + to_string(h->version) + ", expected " + to_string(SNAPSHOT_VERSION);
+		return;
+	}
+	if (h->n_nodes < 0 || h->n_tubes < 0 || h->n_nodes > INT32_MAX || h->n_tubes > INT32_MAX)
+	{
+		err = string(filename) + ": bad node or tube count";
+		return;
+	}
+	for (int f = 0; f < SNAP_FIELDS; f++) //every array must lie inside the file
+	{
+		if (h->offset[f] == 0)
+		{
+			if (f == SNAP_HEAD && !(h->flags & SNAPSHOT_HEADS)) continue;
+			err = string(filename) + ": snapshot is missing an array";
+			return;
+		}
+		bool pernode = (f <= SNAP_HEAD);
+		uint64_t count = pernode ? h->n_nodes : h->n_tubes;
+		uint64_t elem = (f == SNAP_N1 || f == SNAP_N2) ? sizeof(int32_t) : sizeof(double);
+		if (h->offset[f] % 64 != 0 || h->offset[f] > file.size() || count * elem > file.size() - h->offset[f])
+		{
+			err = string(filename) + ": snapshot is truncated";
+			return;
+		}
+	}
+	hdr = h;
+	const int32_t* a = n1();
+	const int32_t* b = n2();
+	for (int i = 0; i < tubes(); i++) //node indices must be usable without further checks
+	{
+		if (a[i] < 0 || a[i] >= nodes() || b[i] < 0 || b[i] >= nodes())
+		{
+			hdr = NULL;
+			err = string(filename) + ": tube " + to_string(i + 1) + " refers to a node out of range";
+			return;
+		}
+	}
+}
+
+namespace
+{
+//writes n bytes at offset off, zero padding from the current position
+bool putarray(FILE* f, uint64_t& pos, uint64_t off, const void* p, size_t n)
+{
+	static const char zeros[64] = {0};
+	while (pos < off)
+	{
+		size_t k = (off - pos < sizeof(zeros)) ? (size_t)(off - pos) : sizeof(zeros);
+		if (fwrite(zeros, 1, k, f) != k) return false;
+		pos += k;
+	}
+	if (n > 0 && fwrite(p, 1, n, f) != n) return false;
+	pos += n;
+	return true;
+}
+}
+
+bool writesnapshot(const char* filename, int n_nodes, int n_tubes,
+	const double* x, const double* y, const double* Q, const double* head,
+	const int* n1, const int* n2, const double* dia, const double* length, const double* B,
+	string& err)
+{
+	static_assert(sizeof(int) == sizeof(int32_t), "node indices are stored as 32 bit integers");
+	const void* arrays[SNAP_FIELDS] = {x, y, Q, head, n1, n2, dia, length, B};
+	snapheader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	h.version = SNAPSHOT_VERSION;
+	h.byteorder = SNAPSHOT_BYTEORDER;
+	h.flags = head ? SNAPSHOT_HEADS : 0;
+	h.n_nodes = n_nodes;
+	h.n_tubes = n_tubes;
+	size_t bytes[SNAP_FIELDS];
+	uint64_t pos = sizeof(snapheader);
+	for (int f = 0; f < SNAP_FIELDS; f++)
+	{
+		bytes[f] = (size_t)((f <= SNAP_HEAD) ? n_nodes : n_tubes) * ((f == SNAP_N1 || f == SNAP_N2) ? sizeof(int32_t) : sizeof(double));
+		if (arrays[f] == NULL) continue;
+		h.offset[f] = (pos + 63) / 64 * 64;
+		pos = h.offset[f] + bytes[f];
+	}
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		err = string(filename) + ": cannot write file";
+		return false;
+	}
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	pos = sizeof(h);
+	for (int k = 0; ok && k < SNAP_FIELDS; k++)
+		if (arrays[k] != NULL) ok = putarray(f, pos, h.offset[k], arrays[k], bytes[k]);
+	if (fclose(f) != 0) ok = false;
+	if (!ok)
+	{
+		err = string(filename) + ": write failed";
+		return false;
+	}
+	err.clear();
+	return true;
+}
+
+/********************************************************/
+//Writers: networks and results
+
+namespace
+{
+const size_t NUMBER_CHARS = 24; //"-1.2345678901234567e-308", the longest shortest form
+const size_t INDEX_CHARS = 11; //"-2147483648"
+
+inline char* putnumber(char* p, double v)
+{
+	return to_chars(p, p + NUMBER_CHARS, v).ptr;
+}
+
+inline char* putindex(char* p, long i)
+{
+	return to_chars(p, p + INDEX_CHARS, i).ptr;
+}
+
+inline char* puttext(char* p, const char* s)
+{
+	size_t n = strlen(s);
+	memcpy(p, s, n);
+	return p + n;
+}
+
+//one write of the whole buffer
+bool putfile(const char* filename, const char* data, size_t n, string& err)
+{
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		err = string(filename) + ": cannot write file";
+		return false;
+	}
+	setvbuf(f, NULL, _IONBF, 0); //the buffer is already whole, stdio would only copy it
+	bool ok = n == 0 || fwrite(data, 1, n, f) == n;
+	if (fclose(f) != 0) ok = false;
+	if (!ok)
+	{
+		err = string(filename) + ": write failed";
+		return false;
+	}
+	return true;
+}
+}
+
+bool writenetwork(const char* filename, const netdata& net, string& err)
+{
+	vector<char> buf(2 * INDEX_CHARS + 2 + (size_t)net.n_nodes * (3 * NUMBER_CHARS + 3)
+		+ (size_t)net.n_tubes * (2 * INDEX_CHARS + NUMBER_CHARS + 3));
+	char* p = buf.data();
+	p = putindex(p, net.n_nodes);
+	*p++ = '\n';
+	p = putindex(p, net.n_tubes);
+	*p++ = '\n';
+	for (int i = 0; i < net.n_nodes; i++)
+	{
+		p = putnumber(p, net.x[i]);
+		*p++ = ' ';
+		p = putnumber(p, net.y[i]);
+		*p++ = ' ';
+		p = putnumber(p, net.Q[i]);
+		*p++ = '\n';
+	}
+	for (int i = 0; i < net.n_tubes; i++)
+	{
+		p = putindex(p, net.n1[i] + 1);
+		*p++ = ' ';
+		p = putindex(p, net.n2[i] + 1);
+		*p++ = ' ';
+		p = putnumber(p, net.dia[i]);
+		*p++ = '\n';
+	}
+	if (!putfile(filename, buf.data(), p - buf.data(), err))
+		return false;
+	err.clear();
+	return true;
+}
+
+bool writeresultscsv(const char* nodefile, const char* tubefile, int n_nodes, int n_tubes,
+	const double* head, const double* Q, const int* n1, const int* n2, const double* q,
+	string& err)
+{
+	vector<char> buf;
+	if (nodefile != NULL)
+	{
+		buf.resize(32 + (size_t)n_nodes * (INDEX_CHARS + 2 * NUMBER_CHARS + 3));
+		char* p = puttext(buf.data(), "node,head,demand\n");
+		for (int i = 0; i < n_nodes; i++)
+		{
+			p = putindex(p, i + 1);
+			*p++ = ',';
+			p = putnumber(p, head[i]);
+			*p++ = ',';
+			p = putnumber(p, Q[i]);
+			*p++ = '\n';
+		}
+		if (!putfile(nodefile, buf.data(), p - buf.data(), err))
+			return false;
+	}
+	if (tubefile != NULL)
+	{
+		buf.resize(32 + (size_t)n_tubes * (3 * INDEX_CHARS + NUMBER_CHARS + 4));
+		char* p = puttext(buf.data(), "tube,node1,node2,flow\n");
+		for (int i = 0; i < n_tubes; i++)
+		{
+			p = putindex(p, i + 1);
+			*p++ = ',';
+			p = putindex(p, n1[i] + 1);
+			*p++ = ',';
+			p = putindex(p, n2[i] + 1);
+			*p++ = ',';
+			p = putnumber(p, q[i]);
+			*p++ = '\n';
+		}
+		if (!putfile(tubefile, buf.data(), p - buf.data(), err))
+			return false;
+	}
+	err.clear();
+	return true;
+}
+
+string formatflows(int n_tubes, const double* q)
+{
+	static const char prefix[] = "Tube number--  ";
+	static const char middle[] = "\tflow--  ";
+	string out((size_t)n_tubes * (sizeof(prefix) + sizeof(middle) + INDEX_CHARS + NUMBER_CHARS), '\0');
+	char* begin = &out[0];
+	char* p = begin;
+	for (int i = 0; i < n_tubes; i++)
+	{
+		p = puttext(p, prefix);
+		p = putindex(p, i + 1);
+		p = puttext(p, middle);
+		p = to_chars(p, p + NUMBER_CHARS, q[i], chars_format::general, 6).ptr;
+		*p++ = '\n';
+	}
+	out.resize(p - begin);
+	return out;
+}
+
+bool writeresults(const char* filename, int n_nodes, int n_tubes,
+	const double* head, const double* Q, const int* n1, const int* n2, const double* q,
+	string& err)
+{// the columns are contiguous already, they go out straight from the arrays
+	const void* columns[RES_COLUMNS] = {head, Q, n1, n2, q};
+	resultheader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, RESULTS_MAGIC, sizeof(RESULTS_MAGIC));
+	h.version = RESULTS_VERSION;
+	h.byteorder = SNAPSHOT_BYTEORDER;
+	h.n_nodes = n_nodes;
+	h.n_tubes = n_tubes;
+	size_t bytes[RES_COLUMNS];
+	uint64_t pos = sizeof(resultheader);
+	for (int c = 0; c < RES_COLUMNS; c++)
+	{
+		bytes[c] = (c <= RES_DEMAND) ? (size_t)n_nodes * sizeof(double)
+			: (size_t)n_tubes * ((c == RES_FLOW) ? sizeof(double) : sizeof(int32_t));
+		h.offset[c] = (pos + 63) / 64 * 64;
+		pos = h.offset[c] + bytes[c];
+	}
+
+	FILE* f = fopen(filename, "wb");
+	if (!f)
+	{
+		err = string(filename) + ": cannot write file";
+		return false;
+	}
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	pos = sizeof(h);
+	for (int c = 0; ok && c < RES_COLUMNS; c++)
+		ok = putarray(f, pos, h.offset[c], columns[c], bytes[c]);
+	if (fclose(f) != 0) ok = false;
+	if (!ok)
+	{
+		err = string(filename) + ": write failed";
+		return false;
+	}
+	err.clear();
+	return true;
+}
+
+netresults::netresults(const char* filename)
+	:file(filename),hdr(NULL)
+{
+	if (!file.isopen())
+	{
+		err = string(filename) + ": cannot open file";
+		return;
+	}
+	const resultheader* h = (const resultheader*)file.begin();
+	if (file.size() < sizeof(resultheader) || memcmp(h->magic, RESULTS_MAGIC, sizeof(RESULTS_MAGIC)) != 0)
+	{
+		err = string(filename) + ": not a pipe network results file";
+		return;
+	}
+	if (h->byteorder != SNAPSHOT_BYTEORDER)
+	{
+		err = string(filename) + ": results file was written on a machine of the other byte order";
+		return;
+	}
+	if (h->version != RESULTS_VERSION)
+	{
+		err = string(filename) + ": results version " + to_string(h->version) + ", expected " + to_string(RESULTS_VERSION);
+		return;
+	}
+	if (h->n_nodes < 0 || h->n_tubes < 0 || h->n_nodes > INT32_MAX || h->n_tubes > INT32_MAX)
+	{
+		err = string(filename) + ": bad node or tube count";
+		return;
+	}
+	for (int c = 0; c < RES_COLUMNS; c++) //every column must lie inside the file
+	{
+		uint64_t count = (c <= RES_DEMAND) ? h->n_nodes : h->n_tubes;
+		uint64_t elem = (c == RES_N1 || c == RES_N2) ? sizeof(int32_t) : sizeof(double);
+		if (h->offset[c] == 0 || h->offset[c] % 64 != 0 || h->offset[c] > file.size() || count * elem > file.size() - h->offset[c])
+		{
+			err = string(filename) + ": results file is truncated";
+			return;
+		}
+	}
+	hdr = h;
+}
@@ -0,0 +1,157 @@
+/*
+	netio.h
+	Fast loading of pipe network input files
+*/
+#ifndef NETIO_H_
+#define NETIO_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct solvestats;
+
+//STRUCT NETDATA: a network as read from the input file, one entry per node/tube
+struct netdata
+{
+	int n_nodes = 0;
+	int n_tubes = 0;
+	std::vector<double> x, y, Q; //node coordinates and flowrate
+	std::vector<int> n1, n2; //tube end nodes, 0-based (the file counts from 1)
+	std::vector<double> dia; //tube diameters
+};
+
+//CLASS MAPPEDFILE: read-only view of a whole file, memory mapped where the OS allows
+class mappedfile
+{
+private:
+	const char* data;
+	size_t length;
+	bool mapped; //false: data is a heap copy
+	bool opened;
+public:
+	mappedfile(const char*);
+	mappedfile(const mappedfile&) = delete;
+	mappedfile& operator=(const mappedfile&) = delete;
+	~mappedfile();
+	bool isopen() const { return opened; }
+	const char* begin() const { return data; }
+	const char* end() const { return data + length; }
+	size_t size() const { return length; }
+};
+
+//reads a network in the pipedata.txt format: node count, tube count, one "x y Q"
+//line per node and one "node1 node2 diameter" line per tube. blank lines are skipped.
+//returns false and sets err to "file:line: message" for the first malformed line.
+//stats, if given, gets the time spent as PHASE_PARSE
+bool readnetwork(const char* filename, netdata& net, std::string& err, solvestats* stats = NULL);
+//same, for a buffer already in memory; name is only used in messages
+bool parsenetwork(const char* begin, const char* end, const char* name, netdata& net, std::string& err);
+//writes a network in the same format, in one write; the numbers read back to the same doubles
+bool writenetwork(const char* filename, const netdata& net, std::string& err);
+
+//binary snapshot of a network: a fixed header followed by one array per field,
+//each starting on a 64 byte boundary so it can be used in place from the mapping
+const char SNAPSHOT_MAGIC[8] = {'P','I','P','E','N','E','T','\0'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const uint32_t SNAPSHOT_BYTEORDER = 0x01020304; //reads back swapped on the other byte order
+const uint32_t SNAPSHOT_HEADS = 1; //flag: solved heads are stored
+
+enum snapfield { SNAP_X, SNAP_Y, SNAP_Q, SNAP_HEAD, SNAP_N1, SNAP_N2, SNAP_DIA, SNAP_LENGTH, SNAP_B, SNAP_FIELDS };
+
+struct snapheader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t flags;
+	uint32_t reserved;
+	int64_t n_nodes;
+	int64_t n_tubes;
+	uint64_t offset[SNAP_FIELDS]; //byte offset of each array, 0 if it is not stored
+};
+
+//CLASS NETSNAPSHOT: a snapshot file mapped read-only, the arrays point into the mapping
+class netsnapshot
+{
+private:
+	mappedfile file;
+	const snapheader* hdr; //NULL if the file is not a valid snapshot
+	std::string err;
+	const void* field(snapfield f) const { return hdr->offset[f] ? file.begin() + hdr->offset[f] : NULL; }
+public:
+	netsnapshot(const char*);
+	bool isvalid() const { return hdr != NULL; }
+	const std::string& error() const { return err; }
+	int nodes() const { return (int)hdr->n_nodes; }
+	int tubes() const { return (int)hdr->n_tubes; }
+	bool hasheads() const { return (hdr->flags & SNAPSHOT_HEADS) != 0; }
+	const double* x() const { return (const double*)field(SNAP_X); }
+	const double* y() const { return (const double*)field(SNAP_Y); }
+	const double* Q() const { return (const double*)field(SNAP_Q); }
+	const double* head() const { return (const double*)field(SNAP_HEAD); } //NULL if not stored
+	const int32_t* n1() const { return (const int32_t*)field(SNAP_N1); } //0-based
+	const int32_t* n2() const { return (const int32_t*)field(SNAP_N2); }
+	const double* dia() const { return (const double*)field(SNAP_DIA); }
+	const double* length() const { return (const double*)field(SNAP_LENGTH); }
+	const double* B() const { return (const double*)field(SNAP_B); }
+};
+
+//writes a snapshot; head may be NULL. n1/n2 are 0-based node indices
+bool writesnapshot(const char* filename, int n_nodes, int n_tubes,
+	const double* x, const double* y, const double* Q, const double* head,
+	const int* n1, const int* n2, const double* dia, const double* length, const double* B,
+	std::string& err);
+
+//results of a solve for other tools. the text writers format everything into one buffer
+//sized for the longest possible lines and hand it to the OS in a single write; numbers
+//are the shortest form that reads back to the same double. nodes and tubes count from 1
+//CSV tables "node,head,demand" and "tube,node1,node2,flow"; either file may be NULL
+bool writeresultscsv(const char* nodefile, const char* tubefile, int n_nodes, int n_tubes,
+	const double* head, const double* Q, const int* n1, const int* n2, const double* q,
+	std::string& err);
+//"Tube number--  i<tab>flow--  q" lines, 6 significant digits as cout prints them
+std::string formatflows(int n_tubes, const double* q);
+
+//binary columnar results: a fixed header, then one array per column on a 64 byte
+//boundary. n1/n2 are 0-based here, as in snapshots
+const char RESULTS_MAGIC[8] = {'P','N','E','T','R','E','S','\0'};
+const uint32_t RESULTS_VERSION = 1;
+
+enum resultcolumn { RES_HEAD, RES_DEMAND, RES_N1, RES_N2, RES_FLOW, RES_COLUMNS };
+
+struct resultheader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder; //SNAPSHOT_BYTEORDER
+	int64_t n_nodes;
+	int64_t n_tubes;
+	uint64_t offset[RES_COLUMNS]; //byte offset of each column
+};
+
+bool writeresults(const char* filename, int n_nodes, int n_tubes,
+	const double* head, const double* Q, const int* n1, const int* n2, const double* q,
+	std::string& err);
+
+//CLASS NETRESULTS: a results file mapped read-only, the columns point into the mapping
+class netresults
+{
+private:
+	mappedfile file;
+	const resultheader* hdr; //NULL if the file is not a valid results file
+	std::string err;
+	const void* column(resultcolumn c) const { return file.begin() + hdr->offset[c]; }
+public:
+	netresults(const char*);
+	bool isvalid() const { return hdr != NULL; }
+	const std::string& error() const { return err; }
+	int nodes() const { return (int)hdr->n_nodes; }
+	int tubes() const { return (int)hdr->n_tubes; }
+	const double* head() const { return (const double*)column(RES_HEAD); }
+	const double* Q() const { return (const double*)column(RES_DEMAND); }
+	const int32_t* n1() const { return (const int32_t*)column(RES_N1); } //0-based
+	const int32_t* n2() const { return (const int32_t*)column(RES_N2); }
+	const double* q() const { return (const double*)column(RES_FLOW); }
+};
+#endif
@@ -1,73 +1,83 @@
 #include"classes.h"
+#include<cmath>
 
-//Functions of class node
-double node::getx()
-{return x;}
-double node::gety()
-{return y;}
-int node::getnum()
-{return num;}
-double node::getQ()
-{	return Q;}
-/*void node::display()
-{	cout<<num<<"\t"<<x<<","<<y<<"\t"<<Q<<endl;}*/
+//Tube conductance
 
-void node::definehead(double n)
+double conductance(double dia,double length)
 {
-	head=n;
-	//cout<<"head = " <<head<<endl;
-}
-double node::gethead()
-{
-	return head;
+	return (3.14*9.81*(dia*dia*dia*dia))/(128*length*1e-6);
 }
 /********************************************************/
 /********************************************************/
-//Functions of class tube
+//Functions of struct netcore
 
-tube::tube(int number,node* A,node* B,int NoOne,int NoTwo,double Dia)
+void netcore::resize(int nodes,int tubes)
 {
-		num=number;
-		nodeone=NoOne;
-		nodetwo=NoTwo;
-		a=A; //a is a pointer to node which has x and y members. 
-		b=B;
-		dia=Dia;
-		calclength();
-		calcB();
+	n_nodes=nodes;
+	n_tubes=tubes;
+	x.resize(nodes); y.resize(nodes); Q.resize(nodes); head.assign(nodes,0.0);
+	fixed.assign(nodes,0);
+	if (nodes>0) fixed[0]=1; //node 1 is the reference head
+	n1.resize(tubes); n2.resize(tubes);
+	dia.resize(tubes); length.resize(tubes); B.resize(tubes); q.assign(tubes,0.0);
 }
-void tube::calclength()
+void netcore::calclength()
 {
-	double xa,xb,ya,yb;
-	xa=a->getx(); //a and b are pointers of type node >>> now it can access getx() function member of class  node
-	xb=b->getx(); //so now a and b have access to data members of class node
-	ya=a->gety();
-	yb=b->gety();
-	length=sqrt(((xa-xb)*(xa-xb)+(ya-yb)*(ya-yb)));
+	const double* px=x.data();
+	const double* py=y.data();
+	const int* a=n1.data();
+	const int* b=n2.data();
+	double* len=length.data();
+	for (int i=0;i<n_tubes;i++)
+	{
+		double dx=px[a[i]]-px[b[i]];
+		double dy=py[a[i]]-py[b[i]];
+		len[i]=sqrt(dx*dx+dy*dy);
+	}
 }
-void tube::calcB()
+void netcore::calcB()
 {
-	B=(3.14*9.81*(dia*dia*dia*dia))/(128*length*1e-6);
-	//cout<<"b calculated---"<<B<<endl;   //can be used to test the B values
+	const double* d=dia.data();
+	const double* len=length.data();
+	double* pB=B.data();
+	for (int i=0;i<n_tubes;i++)
+		pB[i]=conductance(d[i],len[i]);
 }
-/*void tube::display()
+void netcore::calcflow()
 {
-	cout<<num<<"\t"<<a->getnum()<<"\t"<<b->getnum()<<"\t"<<dia<<"\n";
-}*/
-
-int tube::getn1()
-{	return nodeone;}
-int tube::getn2()
-{return nodetwo;}
-double tube::getB()
-{return B;}
-
-
-void tube::displayflow()
-{
-	 double h1,h2;
-	 h1=a->gethead();
-	 h2=b->gethead();
-	 // cout<<"head of first node"<<h1<<"head of second node"<<h2<<endl;    //for testing purpose
-	 cout<<"Tube number--  "<<num<<"\t"<<"flow--  "<<B*(h1-h2)<<"\n";
+	const double* h=head.data();
+	const int* a=n1.data();
+	const int* b=n2.data();
+	const double* pB=B.data();
+	double* pq=q.data();
+	for (int i=0;i<n_tubes;i++)
+		pq[i]=pB[i]*(h[a[i]]-h[b[i]]);
+}
+int netcore::components(vector<int>& comp) const
+{// union-find with path halving and union by size over the tubes that carry flow
+	vector<int> up(n_nodes), size(n_nodes,1);
+	for (int i=0;i<n_nodes;i++) up[i]=i;
+	auto root=[&](int i)
+	{
+		while (up[i]!=i) { up[i]=up[up[i]]; i=up[i]; }
+		return i;
+	};
+	for (int t=0;t<n_tubes;t++)
+	{
+		if (B[t]==0.0) continue; //closed
+		int a=root(n1[t]), b=root(n2[t]);
+		if (a==b) continue;
+		if (size[a]<size[b]) swap(a,b);
+		up[b]=a;
+		size[a]+=size[b];
+	}
+	comp.assign(n_nodes,-1);
+	int n_comp=0;
+	for (int i=0;i<n_nodes;i++)
+	{
+		int r=root(i);
+		if (comp[r]<0) comp[r]=n_comp++;
+		comp[i]=comp[r];
+	}
+	return n_comp;
 }
@@ -0,0 +1,280 @@
+/*
+	ordering.cpp
+	reverse Cuthill-McKee and approximate minimum degree orderings,
+	graph partitioning
+*/
+#include <algorithm>
+#include <vector>
+#include "MatVec.h"
+#include "ordering.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// reverse Cuthill-McKee
+//---------------------------------------------------------------------------------
+// breadth first search from root over the nodes not yet numbered, neighbours in
+// order of increasing degree. appends to order, returns the last level's size
+static int cmlevels(int root, const int* fnz, const int* clm, const vector<int>& deg,
+                    vector<char>& done, vector<int>& order, int& depth)
+{
+  size_t head = order.size();
+  order.push_back(root);
+  done[root] = 1;
+  depth = 0;
+  int lastwidth = 1;
+  while (head < order.size()) {
+    size_t levelend = order.size();
+    for (; head < levelend; head++) {
+      int i = order[head];
+      size_t first = order.size();
+      for (int p = fnz[i]; p < fnz[i + 1]; p++) {
+        int j = clm[p];
+        if (!done[j]) { done[j] = 1; order.push_back(j); }
+      }
+      sort(order.begin() + first, order.end(),
+           [&](int a, int b) { return deg[a] < deg[b] || (deg[a] == deg[b] && a < b); });
+    }
+    if (order.size() > levelend) {
+      depth++;
+      lastwidth = (int)(order.size() - levelend);
+    }
+  }
+  return lastwidth;
+}
+
+void rcmorder(const SparseMtx& A, int* perm)
+{
+  const int n = A.size();
+  const int* fnz = A.getfnz();
+  const int* clm = A.getclm();
+  vector<int> deg(n);
+  for (int i = 0; i < n; i++) deg[i] = fnz[i + 1] - fnz[i];
+  vector<char> done(n, 0), trial(n, 0);
+  vector<int> order, probe;
+  order.reserve(n);
+
+  for (int s = 0; s < n; s++) {
+    if (done[s]) continue;
+    // pseudo-peripheral root: restart from a low degree node of the last
+    // level while the level structure gets deeper
+    int root = s, depth = 0;
+    for (int pass = 0; pass < 8; pass++) {
+      probe.clear();
+      trial = done;
+      int d;
+      int width = cmlevels(root, fnz, clm, deg, trial, probe, d);
+      if (pass > 0 && d <= depth) break;
+      depth = d;
+      int best = probe.back();						// lowest degree in the last level
+      for (size_t k = probe.size() - width; k < probe.size(); k++)
+        if (deg[probe[k]] < deg[best]) best = probe[k];
+      if (best == root) break;
+      root = best;
+    }
+    cmlevels(root, fnz, clm, deg, done, order, depth);
+  }
+  for (int k = 0; k < n; k++) perm[k] = order[n - 1 - k];
+}
+
+//---------------------------------------------------------------------------------
+// approximate minimum degree
+//---------------------------------------------------------------------------------
+// minimum degree on the quotient graph: an eliminated node becomes an element
+// holding the clique of its neighbours, elements inside a new element are
+// absorbed, and degrees are the approximate external degrees of Amestoy,
+// Davis and Duff: |A_i| + |L_p \ i| + sum of |L_e \ L_p| over the other elements
+void amdorder(const SparseMtx& A, int* perm)
+{
+  const int n = A.size();
+  const int* fnz = A.getfnz();
+  const int* clm = A.getclm();
+  vector<vector<int> > adj(n);						// A_i: variables next to variable i
+  vector<vector<int> > elm(n);						// E_i: elements next to variable i
+  vector<vector<int> > var(n);						// L_e: variables of element e
+  vector<int> deg(n);
+  vector<char> eliminated(n, 0), alive(n, 0);		// alive: element not absorbed
+  vector<int> mark(n, -1), wstamp(n, -1), w(n, 0);
+
+  for (int i = 0; i < n; i++) {
+    for (int p = fnz[i]; p < fnz[i + 1]; p++)
+      if (clm[p] != i) adj[i].push_back(clm[p]);
+    deg[i] = (int)adj[i].size();
+  }
+
+  // degree lists
+  vector<int> head(n + 1, -1), next(n, -1), prev(n, -1);
+  auto insert = [&](int i) {
+    int d = deg[i];
+    prev[i] = -1;
+    next[i] = head[d];
+    if (head[d] >= 0) prev[head[d]] = i;
+    head[d] = i;
+  };
+  auto remove = [&](int i) {
+    if (prev[i] >= 0) next[prev[i]] = next[i];
+    else head[deg[i]] = next[i];
+    if (next[i] >= 0) prev[next[i]] = prev[i];
+  };
+  for (int i = 0; i < n; i++) insert(i);
+
+  int mindeg = 0;
+  vector<int> lp;
+  for (int k = 0; k < n; k++) {
+    while (head[mindeg] < 0) mindeg++;
+    int p = head[mindeg];
+    remove(p);
+    perm[k] = p;
+    eliminated[p] = 1;
+
+    // new element p: the live variables reachable from p
+    lp.clear();
+    mark[p] = k;
+    for (size_t t = 0; t < adj[p].size(); t++) {
+      int j = adj[p][t];
+      if (!eliminated[j] && mark[j] != k) { mark[j] = k; lp.push_back(j); }
+    }
+    for (size_t t = 0; t < elm[p].size(); t++) {
+      int e = elm[p][t];
+      if (!alive[e]) continue;
+      for (size_t u = 0; u < var[e].size(); u++) {
+        int j = var[e][u];
+        if (!eliminated[j] && mark[j] != k) { mark[j] = k; lp.push_back(j); }
+      }
+      alive[e] = 0;									// absorbed into p
+      vector<int>().swap(var[e]);
+    }
+    vector<int>().swap(adj[p]);
+    vector<int>().swap(elm[p]);
+    var[p] = lp;
+    alive[p] = 1;
+    const int lsize = (int)lp.size();
+
+    // A_i loses p and whatever element p now covers, E_i gains p
+    for (int t = 0; t < lsize; t++) {
+      int i = lp[t];
+      vector<int>& a = adj[i];
+      size_t m = 0;
+      for (size_t u = 0; u < a.size(); u++)
+        if (!eliminated[a[u]] && mark[a[u]] != k) a[m++] = a[u];
+      a.resize(m);
+      vector<int>& e = elm[i];
+      m = 0;
+      for (size_t u = 0; u < e.size(); u++)
+        if (alive[e[u]]) e[m++] = e[u];
+      e.resize(m);
+      e.push_back(p);
+    }
+
+    // w(e) = |L_e \ L_p| for the other elements next to L_p
+    for (int t = 0; t < lsize; t++) {
+      const vector<int>& e = elm[lp[t]];
+      for (size_t u = 0; u + 1 < e.size(); u++) {	// the last one is p
+        int el = e[u];
+        if (wstamp[el] != k) { wstamp[el] = k; w[el] = (int)var[el].size(); }
+        w[el]--;
+      }
+    }
+
+    // approximate degrees; an element with w(e) = 0 lies inside L_p and is absorbed
+    for (int t = 0; t < lsize; t++) {
+      int i = lp[t];
+      vector<int>& e = elm[i];
+      long d = (long)adj[i].size() + lsize - 1;
+      size_t m = 0;
+      for (size_t u = 0; u + 1 < e.size(); u++) {
+        int el = e[u];
+        if (w[el] == 0) {
+          if (alive[el]) { alive[el] = 0; vector<int>().swap(var[el]); }
+          continue;
+        }
+        if (!alive[el]) continue;
+        d += w[el];
+        e[m++] = el;
+      }
+      e[m++] = p;
+      e.resize(m);
+      remove(i);
+      long bound = (long)deg[i] + lsize;
+      if (d > bound) d = bound;
+      if (d > n - k - 2) d = n - k - 2;
+      if (d < 0) d = 0;
+      deg[i] = (int)d;
+      insert(i);
+      if (deg[i] < mindeg) mindeg = deg[i];
+    }
+  }
+}
+
+void fillorder(const SparseMtx& A, int method, int* perm)
+{
+  if (method == ORDER_RCM) rcmorder(A, perm);
+  else if (method == ORDER_AMD) amdorder(A, perm);
+  else for (int k = 0; k < A.size(); k++) perm[k] = k;
+}
+
+//---------------------------------------------------------------------------------
+// graph partitioning
+//---------------------------------------------------------------------------------
+// the nodes of set get parts first..first+k-1. the set is grown breadth first
+// from a pseudo-peripheral node until it holds the share of the first k/2 parts,
+// which keeps both halves connected and their boundary short on network graphs
+static void bisect(const int* fnz, const int* clm, vector<int>& set, int k, int first,
+                   int* part, vector<int>& inset, vector<int>& seen, int& stamp)
+{
+  if (k == 1 || set.size() <= 1) {
+    for (size_t t = 0; t < set.size(); t++) part[set[t]] = first;
+    return;
+  }
+  const int k1 = k/2;
+  const size_t n1 = set.size()*k1/k;
+  int mark = ++stamp;
+  for (size_t t = 0; t < set.size(); t++) inset[set[t]] = mark;
+
+  // breadth first order of the set, restarted on every piece of it
+  vector<int> order;
+  order.reserve(set.size());
+  auto bfs = [&](int root, int vis, vector<int>& out) {
+    size_t head = out.size();
+    out.push_back(root);
+    seen[root] = vis;
+    while (head < out.size()) {
+      int i = out[head++];
+      for (int p = fnz[i]; p < fnz[i + 1]; p++) {
+        int j = clm[p];
+        if (inset[j] == mark && seen[j] != vis) { seen[j] = vis; out.push_back(j); }
+      }
+    }
+  };
+  for (size_t t = 0; t < set.size(); t++) {
+    int s = set[t];
+    if (seen[s] == mark) continue;
+    int root = s;
+    for (int pass = 0; pass < 4; pass++) {			// farthest node, twice over
+      vector<int> probe;
+      int vis = ++stamp;
+      bfs(root, vis, probe);
+      for (size_t u = 0; u < probe.size(); u++) seen[probe[u]] = 0;
+      if (probe.back() == root) break;
+      root = probe.back();
+    }
+    bfs(root, mark, order);
+  }
+
+  vector<int> left(order.begin(), order.begin() + n1);
+  vector<int> right(order.begin() + n1, order.end());
+  vector<int>().swap(order);
+  vector<int>().swap(set);
+  bisect(fnz, clm, left, k1, first, part, inset, seen, stamp);
+  bisect(fnz, clm, right, k - k1, first + k1, part, inset, seen, stamp);
+}
+
+void graphpartition(const SparseMtx& A, int k, int* part)
+{
+  const int n = A.size();
+  if (k < 1) k = 1;
+  vector<int> set(n), inset(n, 0), seen(n, 0);
+  for (int i = 0; i < n; i++) set[i] = i;
+  int stamp = 0;
+  bisect(A.getfnz(), A.getclm(), set, k, 0, part, inset, seen, stamp);
+}
@@ -0,0 +1,25 @@
+/*
+	ordering.h
+	Fill-reducing orderings and partitions of a symmetric sparse matrix
+*/
+#ifndef ORDERING_H_
+#define ORDERING_H_
+
+class SparseMtx;
+
+enum orderingmethod {
+  ORDER_NATURAL = 0,								// rows as numbered
+  ORDER_RCM = 1,									// reverse Cuthill-McKee, small bandwidth
+  ORDER_AMD = 2										// approximate minimum degree, small fill
+};
+
+// perm[k] = row of A that is eliminated k-th. only the pattern of A is used,
+// it must be symmetric
+void rcmorder(const SparseMtx& A, int* perm);
+void amdorder(const SparseMtx& A, int* perm);
+void fillorder(const SparseMtx& A, int method, int* perm);	// any of the methods above
+
+// splits the graph of A into k parts of nearly equal size by recursive
+// bisection along breadth first level structures, part[i] in [0,k)
+void graphpartition(const SparseMtx& A, int k, int* part);
+#endif
@@ -1,123 +1,1098 @@
 //Class pipenet defined here
+#include <cmath>
+#include <iterator>
+#include <sstream>
+#include <utility>
+#include <vector>
 #include "classes.h"
 #include "MatVec.h"
+#include "amg.h"
+#include "netio.h"
+#include "headloss.h"
+#include "ordering.h"
+#include "schur.h"
+#include "telemetry.h"
+#include "threadpool.h"
 
-pipenet::pipenet(ifstream& infile)
+static const int UPDATE_MAXRANK = 32; //changed tubes kept as a low-rank update before refactoring
+static const int REFINE_MAXSWEEPS = 20; //iterative refinement steps of a mixed precision solve
+
+//the rest of the stream through parsenetwork(), the checks of the file loader included;
+//a stream that cannot be read or parsed throws MatVecError with the line
+static netdata parsestream(ifstream& infile, solvestats* stats)
 {
-	infile >> n_nodes; //inputs the first line from the .txt file
-	infile >> n_tubes; //inputs the second line from the .txt file
+	phasetimer timer(stats, PHASE_PARSE);
+	if (!infile)
+		throw MatVecError("input: cannot read the stream");
+	string text((istreambuf_iterator<char>(infile)), istreambuf_iterator<char>());
+	netdata data;
+	string err;
+	if (!parsenetwork(text.data(), text.data() + text.size(), "input", data, err))
+		throw MatVecError(err.c_str());
+	return data;
+}
 
-					   //creating nodes and tubes based on the number of nodes and tubes numbers
-	vec_nodes = new node*[n_nodes];//a vector of size equivalent to the number of nodes which was imported from the .txt file
-	vec_tubes = new tube*[n_tubes];//a vector of size equivalent to the number of tubes
+pipenet::pipenet(ifstream& infile, solvestats* s)
+	:pipenet(parsestream(infile, s), s)
+{
+}
+
+pipenet::pipenet(const netdata& data, solvestats* s)
+	:precond(2),tol(1.0e-10),maxiter(0),iterations(0),residual(0.0),solved(false),
+	lossmodel(LAMINAR),roughness(0.0),newton_htol(1.0e-8),newton_qtol(1.0e-8),newton_maxiter(50),ordering(ORDER_AMD),subdomains(1),GlobalB(NULL),factor(NULL),schur(NULL),mixed(false),n_comp(0),jacobian(NULL),jacfactor(NULL),amgB(NULL),amg(NULL),amgstale(false),status(SOLVE_OK),logstream(NULL),stats(s)
+{
+	if (data.n_nodes < 0 || data.n_tubes < 0 || (int)data.x.size() != data.n_nodes || (int)data.y.size() != data.n_nodes
+		|| (int)data.Q.size() != data.n_nodes || (int)data.n1.size() != data.n_tubes
+		|| (int)data.n2.size() != data.n_tubes || (int)data.dia.size() != data.n_tubes)
+		throw MatVecError("netdata: the arrays do not match the node and tube counts");
+	for (int t = 0; t < data.n_tubes; t++)
+		if (data.n1[t] < 0 || data.n1[t] >= data.n_nodes || data.n2[t] < 0 || data.n2[t] >= data.n_nodes)
+			throw MatVecError(("netdata: tube " + to_string(t + 1) + " refers to a node out of range").c_str());
+	net.resize(data.n_nodes, data.n_tubes);
+	net.x = data.x;
+	net.y = data.y;
+	net.Q = data.Q;
+	net.n1 = data.n1;
+	net.n2 = data.n2;
+	net.dia = data.dia;
+	phasetimer timer(stats, PHASE_GEOMETRY);
+	net.calclength();
+	net.calcB();
+}
 
-	for (int i = 0; i<n_nodes; i++) //this step puts the informations of the x,y-coords and Q of all the nodes into a 2D-array
+pipenet::pipenet(const netsnapshot& snap)
+	:precond(2),tol(1.0e-10),maxiter(0),iterations(0),residual(0.0),solved(false),
+	lossmodel(LAMINAR),roughness(0.0),newton_htol(1.0e-8),newton_qtol(1.0e-8),newton_maxiter(50),ordering(ORDER_AMD),subdomains(1),GlobalB(NULL),factor(NULL),schur(NULL),mixed(false),n_comp(0),jacobian(NULL),jacfactor(NULL),amgB(NULL),amg(NULL),amgstale(false),status(SOLVE_OK),logstream(NULL),stats(NULL)
+{// the arrays are copied out of the mapping as they are, length and B are not recomputed
+	if (!snap.isvalid())
+		throw MatVecError(snap.error().c_str());
+	int n_nodes = snap.nodes();
+	int n_tubes = snap.tubes();
+	net.resize(n_nodes, n_tubes);
+	net.x.assign(snap.x(), snap.x() + n_nodes);
+	net.y.assign(snap.y(), snap.y() + n_nodes);
+	net.Q.assign(snap.Q(), snap.Q() + n_nodes);
+	net.n1.assign(snap.n1(), snap.n1() + n_tubes);
+	net.n2.assign(snap.n2(), snap.n2() + n_tubes);
+	net.dia.assign(snap.dia(), snap.dia() + n_tubes);
+	net.length.assign(snap.length(), snap.length() + n_tubes);
+	net.B.assign(snap.B(), snap.B() + n_tubes);
+	if (snap.head() != NULL)
 	{
-		vec_nodes[i] = NULL; //initialization of the elements
-		double array[3];
-		for (int j = 0; j<3; j++) // creating 3 columns in each row
+		net.head.assign(snap.head(), snap.head() + n_nodes);
+		net.calcflow();
+		solved = true;
+	}
+}
+
+bool pipenet::savesnapshot(const char* filename, bool withheads, string& err)
+{// heads only once solved
+	return writesnapshot(filename, net.n_nodes, net.n_tubes, net.x.data(), net.y.data(), net.Q.data(),
+		(withheads && solved) ? net.head.data() : NULL,
+		net.n1.data(), net.n2.data(), net.dia.data(), net.length.data(), net.B.data(), err);
+}
+
+void pipenet::setsolver(int pn, double eps, int maxit)
+{
+	precond = pn;
+	tol = eps;
+	maxiter = maxit;
+}
+void pipenet::setheadloss(int model, double rough)
+{
+	lossmodel = model;
+	roughness = rough;
+}
+void pipenet::setnewton(double htol, double qtol, int maxit)
+{
+	newton_htol = htol;
+	newton_qtol = qtol;
+	newton_maxiter = maxit;
+}
+int pipenet::getiterations()
+{return iterations;}
+double pipenet::getresidual()
+{return residual;}
+
+SparseMtx pipenet::assemble() const
+{// Permeability matrix, assembled in compressed sparse row form
+	// every tube adds four entries, every node with a fixed head (node 1 by default)
+	// adds its unit diagonal. entries in the rows/columns of fixed nodes are skipped,
+	// that is the Dirichlet boundary condition
+	const vector<char>& fixed = net.fixed;
+	int n_trip = 4 * net.n_tubes + net.n_nodes;
+	int* ia = new int[n_trip];
+	int* ja = new int[n_trip];
+	double* val = new double[n_trip];
+	int m = 0;
+
+	for (int i = 0; i < net.n_nodes; i++)
+	{
+		if (fixed[i]) { ia[m] = i; ja[m] = i; val[m] = 1.0; m++; } // B elements at fixed rows and columns=0, diagonal=1
+	}
+
+	for (int i = 0; i < net.n_tubes; i++)
+	{
+		int a = net.n1[i];
+		int b = net.n2[i];
+		double Bcoef = net.B[i];
+
+											 //********assembly to global Bmatrix
+		if (!fixed[a]) { ia[m] = a; ja[m] = a; val[m] = Bcoef; m++; }
+		if (!fixed[b]) { ia[m] = b; ja[m] = b; val[m] = Bcoef; m++; }
+		if (!fixed[a] && !fixed[b])
 		{
-			infile >> array[j]; //import x, y ,Q as array[] 0, 1, 2
+			ia[m] = a; ja[m] = b; val[m] = -Bcoef; m++;
+			ia[m] = b; ja[m] = a; val[m] = -Bcoef; m++;
 		}
-		vec_nodes[i] = new node(i + 1, array[0], array[1], array[2]); //array 0,1,2 >>> num,x, y,Q(num refers to node number)
-	}						//this has the same format as the constructor of the node class
-							//this re-initializes the values of each row vectors
+	}
+	SparseMtx B(net.n_nodes, m, ia, ja, val); // duplicates (parallel tubes) are summed
+	delete[] ia;
+	delete[] ja;
+	delete[] val;
+	return B;
+}
 
-							// tubes
+void pipenet::report(int s, const string& m)
+{
+	status = s;
+	message = m;
+	if (logstream != NULL)
+		*logstream << m << "\n";
+}
+
+void pipenet::assembleQ(const double* Q, double* rhs, int stride) const
+{// rhs[i*stride] = -Q[i], the appropriate form of Ax=B >>> Bh=-Q. a fixed node gets its
+	// head, and the tubes from it move B*head to the right side of their other end
+	const vector<char>& fixed = net.fixed;
+	for (int i = 0; i < net.n_nodes; i++)
+	{
+		rhs[i * stride] = fixed[i] ? net.head[i] : (-1) * Q[i];
+	}
+	for (int i = 0; i < net.n_tubes; i++)
+	{
+		int a = net.n1[i];
+		int b = net.n2[i];
+		if (fixed[a] && !fixed[b]) rhs[b * stride] += net.B[i] * net.head[a];
+		if (fixed[b] && !fixed[a]) rhs[a * stride] += net.B[i] * net.head[b];
+	}
+}
 
-	int _1stnode, _2ndnode;
+void pipenet::dropfactors()
+{
+	delete factor;
+	delete schur;
+	delete GlobalB;
+	delete jacfactor;
+	delete jacobian;
+	delete amg;
+	delete amgB;
+	amg = NULL;
+	amgB = NULL;
+	factor = NULL;
+	schur = NULL;
+	GlobalB = NULL;
+	updtube.clear();
+	updB.clear();
+	updW.clear();
+	jacfactor = NULL;
+	jacobian = NULL;
+}
 
-	for (int i = 0; i<n_tubes; i++) //this step also creates a 2D array that contains, node a, node b, diameter
+void pipenet::setordering(int method)
+{
+	if (method != ordering) dropfactors(); //the symbolic factorization depends on it
+	ordering = method;
+}
+
+void pipenet::setmixedprecision(bool on)
+{
+	if (on != mixed) dropfactors();
+	mixed = on;
+}
+
+void pipenet::setsubdomains(int k)
+{
+	if (k < 1) k = 1;
+	if (k != subdomains)
+		dropfactors();
+	subdomains = k;
+}
+
+SparseLDL* pipenet::factorwithorder(const SparseMtx& A)
+{// the factors are of P A P^T, solves take and return vectors in node numbering
+	vector<int> perm;
+	if (ordering != ORDER_NATURAL)
 	{
-		double array[3];
-		for (int j = 0; j < 3; j++)
+		phasetimer timer(stats, PHASE_ORDERING);
+		perm.resize(A.size());
+		fillorder(A, ordering, perm.data());
+	}
+	phasetimer timer(stats, PHASE_FACTOR);
+	return new SparseLDL(A, perm.empty() ? NULL : perm.data(), mixed);
+}
+
+int pipenet::singularnode(const SparseLDL* f)
+{
+	int k = f->info() - 1;
+	return f->permutation() ? f->permutation()[k] : k;
+}
+
+void pipenet::findcomponents()
+{// a component without a fixed head leaves the matrix singular: its first node becomes
+	// its reference head 0 and new islands are reported. reference nodes of earlier calls
+	// are freed first, in case tubes have joined their island to the network again
+	vector<int> pinned;
+	pinned.swap(islands);
+	for (size_t k = 0; k < pinned.size(); k++)
+		net.fixed[pinned[k]] = 0;
+	n_comp = net.components(comp);
+	vector<char> anchored(n_comp, 0);
+	for (int i = 0; i < net.n_nodes; i++)
+		if (net.fixed[i]) anchored[comp[i]] = 1;
+	vector<int> nodes(n_comp, 0);
+	for (int i = 0; i < net.n_nodes; i++) nodes[comp[i]]++;
+	for (int i = 0; i < net.n_nodes; i++)
+	{
+		if (anchored[comp[i]]) continue;
+		anchored[comp[i]] = 1;
+		islands.push_back(i);
+		net.fixed[i] = 1;
+		net.head[i] = 0.0;
+	}
+	if (islands == pinned)
+		return;
+	dropfactors(); //the boundary condition pattern changed
+	for (size_t k = 0; k < islands.size(); k++)
+		if (logstream != NULL)
+			*logstream << "floating island of " << nodes[comp[islands[k]]] << " nodes, heads relative to node " << islands[k] + 1 << "\n";
+}
+
+void pipenet::setfixedhead(int i, double h)
+{
+	for (size_t k = 0; k < islands.size(); k++)
+		if (islands[k] == i)
+		{// a reference head of findcomponents() that is now a real one
+			islands.erase(islands.begin() + k);
+			break;
+		}
+	if (!net.fixed[i])
+	{
+		net.fixed[i] = 1;
+		dropfactors(); //the pattern of the matrix changes
+	}
+	net.head[i] = h;
+}
+
+void pipenet::setdemands(const double* Q)
+{
+	for (int i = 0; i < net.n_nodes; i++) net.Q[i] = Q[i];
+}
+
+void pipenet::factorize()
+{
+	status = SOLVE_OK;
+	message.clear();
+	phasetimer boundary(stats, PHASE_BOUNDARY);
+	findcomponents();
+	boundary.stop();
+	delete factor;
+	delete schur;
+	delete GlobalB;
+	factor = NULL;
+	schur = NULL;
+	updtube.clear();
+	updB.clear();
+	updW.clear();
+	phasetimer assembly(stats, PHASE_ASSEMBLY);
+	GlobalB = new SparseMtx(assemble());
+	assembly.stop();
+	int singular = 0;
+	if (subdomains > 1 || n_comp > 1)
+	{// subdomains factored in parallel, then the Schur complement on their interface;
+		// independent components are factored in parallel, there is no interface.
+		// the orderings of the parts are counted as factorization time
+		phasetimer timer(stats, PHASE_FACTOR);
+		if (subdomains > 1)
+			schur = new SchurSolver(*GlobalB, subdomains, ordering, mixed);
+		else
+			schur = new SchurSolver(*GlobalB, comp.data(), n_comp, ordering, mixed);
+		singular = schur->info();
+	}
+	else
+	{
+		factor = factorwithorder(*GlobalB);
+		singular = (factor->info() != 0) ? singularnode(factor) + 1 : 0;
+	}
+	if (singular != 0)
+		report(SOLVE_SINGULAR, "network matrix is singular at node " + to_string(singular));
+	if (stats != NULL)
+	{
+		stats->factorentries = (schur != NULL) ? schur->nnz() : factor->nnz();
+		stats->condition = (singular == 0) ? condition() : 0.0;
+	}
+}
+
+double pipenet::condition()
+{// ||A||_1 ||A^-1||_1, the second estimated as in Hager's method: a few solves with
+	// sign vectors climb to a large column of A^-1. A is symmetric, A^-T is A^-1
+	const int n = net.n_nodes;
+	if (n == 0)
+		return 0.0;
+	vector<double> x(n, 1.0 / n), y(n), z(n);
+	double est = 0.0;
+	for (int k = 0; k < 5; k++)
+	{
+		y = x;
+		if (!factorsolve(y.data(), 1))
+			return 0.0;
+		double ynorm = 0.0;
+		for (int i = 0; i < n; i++) ynorm += fabs(y[i]);
+		if (k > 0 && ynorm <= est)
+			break;
+		est = ynorm;
+		for (int i = 0; i < n; i++) z[i] = (y[i] >= 0.0) ? 1.0 : -1.0;
+		if (!factorsolve(z.data(), 1))
+			return 0.0;
+		int j = 0;
+		double ztx = 0.0;
+		for (int i = 0; i < n; i++)
 		{
-			infile >> array[j];//import a, b ,diameter as array[] 0, 1, 2
+			if (fabs(z[i]) > fabs(z[j])) j = i;
+			ztx += z[i] * x[i];
 		}
-		_1stnode = array[0] - 1;
-		_2ndnode = array[1] - 1;
-		vec_tubes[i] = new tube(i + 1, vec_nodes[_1stnode], vec_nodes[_2ndnode], array[0], array[1], array[2]);
-		//this has the same format as the constructor of the tube class
-		//so it's initializing the data members accordingly
-		//the format is (int num,node* a,node* b,int nodeone,int nodetwo,double dia)
+		if (k > 0 && fabs(z[j]) <= ztx)
+			break;
+		x.assign(n, 0.0); //the unit vector of the largest entry next
+		x[j] = 1.0;
 	}
+	return GlobalB->onenorm() * est;
 }
 
-void pipenet::calcflowrate()
-{// Permeability matrix
-	double** mtxB = new double*[n_nodes];
+void pipenet::tubechanged(int t, double oldB)
+{// the network matrix is A + sum of (B_t - B0_t) u_t u_t^T over the changed tubes, with
+	// u_t = e_n1 - e_n2 on the free nodes. A^-1 u_t is found once, when t first changes
+	amgstale = true;
+	if (factor == NULL && schur == NULL)
+		return; //nothing factored: the next solve assembles the new matrix
+	if ((factor != NULL && factor->info() != 0) || (schur != NULL && schur->info() != 0))
+		return; //singular factors, solves fail until the next factorize()
+	for (size_t j = 0; j < updtube.size(); j++)
+		if (updtube[j] == t) return;
+	const int n = net.n_nodes;
+	int a = net.n1[t], b = net.n2[t];
+	if (net.fixed[a] && net.fixed[b])
+		return; //such a tube is not in the matrix
+	if ((int)updtube.size() >= UPDATE_MAXRANK)
+	{// a full factorization is cheaper than a long update
+		factorize();
+		return;
+	}
+	updtube.push_back(t);
+	updB.push_back(oldB);
+	updW.resize(updW.size() + n, 0.0);
+	double* w = &updW[updW.size() - n];
+	if (!net.fixed[a]) w[a] = 1.0;
+	if (!net.fixed[b]) w[b] = -1.0;
+	if (schur != NULL) schur->solve(w, 1);
+	else factor->solve(w, 1);
+}
 
-	for (int i = 0; i < n_nodes; i++)
+//arguments of the tube edits, MatVecError for those they cannot take
+static void checktube(const char* what, int t, int n_tubes)
+{
+	if (t < 0 || t >= n_tubes)
+		throw MatVecError((string(what) + ": no tube " + to_string(t)).c_str());
+}
+static void checkdiameter(const char* what, double d)
+{
+	if (!(d > 0)) //also NaN
+		throw MatVecError((string(what) + ": diameter must be positive").c_str());
+}
+
+void pipenet::settubediameter(int t, double d)
+{
+	checktube("settubediameter", t, net.n_tubes);
+	checkdiameter("settubediameter", d);
+	double oldB = net.B[t];
+	net.dia[t] = d;
+	net.B[t] = conductance(d, net.length[t]);
+	tubechanged(t, oldB);
+}
+
+void pipenet::removetube(int t)
+{
+	checktube("removetube", t, net.n_tubes);
+	double oldB = net.B[t];
+	net.B[t] = 0.0;
+	net.q[t] = 0.0;
+	tubechanged(t, oldB);
+}
+
+int pipenet::addtube(int a, int b, double d)
+{
+	if (a < 0 || a >= net.n_nodes || b < 0 || b >= net.n_nodes)
+		throw MatVecError(("addtube: node number out of range 0.." + to_string(net.n_nodes - 1)).c_str());
+	checkdiameter("addtube", d);
+	double dx = net.x[a] - net.x[b];
+	double dy = net.y[a] - net.y[b];
+	if (dx == 0 && dy == 0) //also a == b
+		throw MatVecError(("addtube: nodes " + to_string(a) + " and " + to_string(b) + " are at the same point").c_str());
+	int t = net.n_tubes++;
+	net.n1.push_back(a);
+	net.n2.push_back(b);
+	net.dia.push_back(d);
+	net.length.push_back(sqrt(dx * dx + dy * dy));
+	net.B.push_back(conductance(d, net.length[t]));
+	net.q.push_back(0.0);
+	delete jacfactor; //the Jacobian keeps the positions of every tube
+	delete jacobian;
+	jacfactor = NULL;
+	jacobian = NULL;
+	tubechanged(t, 0.0); //a tube of B 0 was there all along
+	return t;
+}
+
+bool pipenet::factorsolve(double* X, int nrhs)
+{
+	if ((factor != NULL && factor->info() != 0) || (schur != NULL && schur->info() != 0))
+		return false; //factorize() found a zero pivot
+	const int m = (int)updtube.size();
+	vector<double> D(m);
+	vector<const double*> W(m);
+	for (int j = 0; j < m; j++)
 	{
-		mtxB[i] = new double[n_nodes];
+		D[j] = net.B[updtube[j]] - updB[j];
+		W[j] = &updW[(long)j * net.n_nodes];
 	}
+	if (schur != NULL) schur->solve(X, nrhs);
+	else factor->solve(X, nrhs);
+	return lowrank(m, updtube.data(), D.data(), W.data(), X, nrhs);
+}
 
-	for (int i = 0; i < n_nodes; i++)
+void pipenet::multiply(const double* X, double* Y, int nrhs) const
+{// the factored matrix and the tube changes made since, right sides interleaved as in solve
+	const int n = net.n_nodes;
+	const int* fnz = GlobalB->getfnz();
+	const int* clm = GlobalB->getclm();
+	const double* sra = GlobalB->getsra();
+	for (int i = 0; i < n; i++)
+	{
+		double* y = Y + (long)i * nrhs;
+		for (int r = 0; r < nrhs; r++) y[r] = 0.0;
+		for (int p = fnz[i]; p < fnz[i + 1]; p++)
+		{
+			const double* x = X + (long)clm[p] * nrhs;
+			for (int r = 0; r < nrhs; r++) y[r] += sra[p] * x[r];
+		}
+	}
+	for (size_t j = 0; j < updtube.size(); j++)
+	{
+		int t = updtube[j];
+		int a = net.fixed[net.n1[t]] ? -1 : net.n1[t];
+		int b = net.fixed[net.n2[t]] ? -1 : net.n2[t];
+		double dB = net.B[t] - updB[j];
+		for (int r = 0; r < nrhs; r++)
+		{
+			double dq = dB * ((a >= 0 ? X[(long)a * nrhs + r] : 0.0) - (b >= 0 ? X[(long)b * nrhs + r] : 0.0));
+			if (a >= 0) Y[(long)a * nrhs + r] += dq;
+			if (b >= 0) Y[(long)b * nrhs + r] -= dq;
+		}
+	}
+}
+
+bool pipenet::directsolve(double* X, int nrhs, int& sweeps)
+{// single precision factors give about 7 digits, iterative refinement with the residual
+	// in double brings the heads to tol: X += A^-1 (B - A X) until the residual is below
+	// tol or stops shrinking
+	sweeps = 0;
+	if (!mixed)
+		return factorsolve(X, nrhs);
+	const long len = (long)net.n_nodes * nrhs;
+	vector<double> B(X, X + len), R(len), bnorm(nrhs, 0.0), rnorm(nrhs);
+	for (long k = 0; k < len; k++) bnorm[k % nrhs] += B[k] * B[k];
+	if (!factorsolve(X, nrhs))
+		return false;
+	double last = 0.0;
+	for (; sweeps < REFINE_MAXSWEEPS; sweeps++)
+	{
+		multiply(X, R.data(), nrhs);
+		for (int r = 0; r < nrhs; r++) rnorm[r] = 0.0;
+		for (long k = 0; k < len; k++)
+		{
+			R[k] = B[k] - R[k];
+			rnorm[k % nrhs] += R[k] * R[k];
+		}
+		double worst = 0.0; //largest relative residual
+		for (int r = 0; r < nrhs; r++)
+			if (bnorm[r] > 0.0) worst = max(worst, sqrt(rnorm[r] / bnorm[r]));
+		if (worst <= tol || (sweeps > 0 && worst > 0.5 * last))
+			break;
+		last = worst;
+		if (!factorsolve(R.data(), nrhs))
+			return false;
+		for (long k = 0; k < len; k++) X[k] += R[k];
+	}
+	return true;
+}
+
+bool pipenet::lowrank(int m, const int* tubes, const double* D, const double* const* W, double* X, int nrhs) const
+{// X holds Y = A^-1 X by the factors. the Sherman-Morrison-Woodbury correction for the
+	// changed tubes, with W = A^-1 U and D = diag(B - B0), is
+	// (A + U D U^T)^-1 X = Y - W (I + D U^T W)^-1 D U^T Y
+	if (m == 0)
+		return true;
+	const int n = net.n_nodes;
+	vector<int> a(m), b(m); //ends of each tube, -1 if fixed
+	for (int j = 0; j < m; j++)
+	{
+		int t = tubes[j];
+		a[j] = net.fixed[net.n1[t]] ? -1 : net.n1[t];
+		b[j] = net.fixed[net.n2[t]] ? -1 : net.n2[t];
+	}
+	Mtx C(m); //I + D U^T W
+	for (int i = 0; i < m; i++)
+		for (int j = 0; j < m; j++)
+		{
+			const double* w = W[j];
+			double uw = (a[i] >= 0 ? w[a[i]] : 0.0) - (b[i] >= 0 ? w[b[i]] : 0.0);
+			C[i][j] = (i == j ? 1.0 : 0.0) + D[i] * uw;
+		}
+	const double cnorm = C.onenorm();
+	LUMtx lu(std::move(C)); //factored in place, C is not needed again
+	if (lu.info() != 0)
+		return false;
+	double cinv = 0.0; //a tube change that cuts off part of the network makes C singular,
+	Vcr e(m); //found in rounding error only: look at its condition number
+	for (int j = 0; j < m; j++)
 	{
-		for (int j = 0; j < n_nodes; j++)
+		for (int i = 0; i < m; i++) e[i] = (i == j) ? 1.0 : 0.0;
+		lu.solve(e);
+		cinv = max(cinv, e.onenorm());
+	}
+	if (cnorm * cinv > 1.0e12)
+		return false;
+	Vcr c(m);
+	for (int r = 0; r < nrhs; r++)
+	{
+		for (int j = 0; j < m; j++)
+			c[j] = D[j] * ((a[j] >= 0 ? X[(long)a[j] * nrhs + r] : 0.0) - (b[j] >= 0 ? X[(long)b[j] * nrhs + r] : 0.0));
+		lu.solve(c);
+		for (int j = 0; j < m; j++)
 		{
-			mtxB[i][j] = 0;
+			const double* w = W[j];
+			for (int i = 0; i < n; i++) X[(long)i * nrhs + r] -= w[i] * c[j];
 		}
-	}//the 2D square matrix is created
+	}
+	return true;
+}
 
+void pipenet::outagebase(vector<double>& y) const
+{
+	y.resize(net.n_nodes);
+	assembleQ(net.Q.data(), y.data(), 1);
+	if (schur != NULL) schur->solve(y.data(), 1);
+	else factor->solve(y.data(), 1);
+}
 
-	for (int i = 0; i < n_tubes; i++)
+bool pipenet::solveoutage(const int* out, int k, const double* y0, double* h, vector<double>& work) const
+{// the tube changes made so far and the outages together are one low-rank update of
+	// the factors. only const members of the factors are used, so threads may share them
+	const int n = net.n_nodes;
+	const int m0 = (int)updtube.size();
+	vector<int> tubes(updtube);
+	vector<double> D(m0);
+	vector<const double*> W(m0);
+	for (int j = 0; j < m0; j++)
 	{
-		int a = vec_tubes[i]->getn1() - 1; //subtracts 1 from node a in the txt file to match the array indeces
-		int b = vec_tubes[i]->getn2() - 1;
-		double Bcoef = vec_tubes[i]->getB(); //calculates B for each tube. [i] indicates an array that contains 
-											 //cout<<i+1<<"\t"<<a+1<<"\t"<<b+1<<"\t"<<Bcoef<<endl;
+		D[j] = net.B[updtube[j]] - updB[j];
+		W[j] = &updW[(long)j * n];
+	}
+	if ((long)work.size() < (long)n * k)
+		work.resize((long)n * k);
+	int nw = 0;
+	bool rhschange = false; //an outage next to a fixed head changes the right side
+	for (int o = 0; o < k; o++)
+	{
+		int t = out[o];
+		int a = net.n1[t], b = net.n2[t];
+		if (net.fixed[a] && net.fixed[b]) continue;
+		if (net.fixed[a] || net.fixed[b]) rhschange = true;
+		int j = 0;
+		while (j < (int)tubes.size() && tubes[j] != t) j++;
+		if (j < m0) D[j] = -updB[j]; //an edited tube: from its factored B to 0
+		if (j < (int)tubes.size()) continue;
+		tubes.push_back(t);
+		D.push_back(-net.B[t]);
+		double* w = &work[(long)nw++ * n];
+		for (int i = 0; i < n; i++) w[i] = 0.0;
+		if (!net.fixed[a]) w[a] = 1.0;
+		if (!net.fixed[b]) w[b] = -1.0;
+		if (schur != NULL) schur->solve(w, 1);
+		else factor->solve(w, 1);
+		W.push_back(w);
+	}
 
-											 //********assembly to global Bmatrix									
-		mtxB[a][a] += Bcoef;
-		mtxB[b][b] += Bcoef;
-		mtxB[a][b] -= Bcoef;
-		mtxB[b][a] -= Bcoef;
-	}//Global matrix B is now created
+	if (y0 != NULL && !rhschange)
+		for (int i = 0; i < n; i++) h[i] = y0[i];
+	else
+	{
+		assembleQ(net.Q.data(), h, 1);
+		for (int o = 0; o < k; o++)
+		{// the closed tubes no longer carry B*head of a fixed end to the right side
+			int t = out[o];
+			int a = net.n1[t], b = net.n2[t];
+			bool repeated = false;
+			for (int p = 0; p < o; p++) repeated = repeated || out[p] == t;
+			if (repeated) continue;
+			if (net.fixed[a] && !net.fixed[b]) h[b] -= net.B[t] * net.head[a];
+			if (net.fixed[b] && !net.fixed[a]) h[a] -= net.B[t] * net.head[b];
+		}
+		if (schur != NULL) schur->solve(h, 1);
+		else factor->solve(h, 1);
+	}
+	return lowrank((int)tubes.size(), tubes.data(), D.data(), W.data(), h, 1);
+}
 
-	 ////****************** Q matrix *******************//
-	double* vec_Q = new double[n_nodes];
+void pipenet::solvescenarios(int nrhs, const double* Q, double* H)
+{// Q holds nrhs demand vectors of n_nodes entries one after the other, H gets the heads
+	// in the same layout. the right sides are solved in blocks that share each pass over L
+	const int BLOCK = 16;
+	const int n_nodes = net.n_nodes;
+	if (lossmodel != LAMINAR)
+	{// the turbulent laws make every scenario a Newton solve of its own
+		report(SOLVE_UNSUPPORTED, "scenarios need the laminar head loss model");
+		return;
+	}
+	if (factor == NULL && schur == NULL)
+		factorize();
+	status = SOLVE_OK;
+	message.clear();
+	phasetimer timer(stats, PHASE_SOLVE);
+	vector<double> X((long)n_nodes * BLOCK);
+	for (int s0 = 0; s0 < nrhs; s0 += BLOCK)
+	{
+		int nb = (nrhs - s0 < BLOCK) ? nrhs - s0 : BLOCK;
+		for (int r = 0; r < nb; r++)
+			assembleQ(Q + (long)(s0 + r) * n_nodes, &X[r], nb);
+		int sweeps;
+		if (!directsolve(X.data(), nb, sweeps))
+		{
+			report(SOLVE_SINGULAR, "network matrix is singular");
+			break;
+		}
+		for (int r = 0; r < nb; r++)
+			for (int i = 0; i < n_nodes; i++)
+				H[(long)(s0 + r) * n_nodes + i] = X[(long)i * nb + r];
+	}
+}
 
-	for (int i = 0; i < n_nodes; i++)
+bool pipenet::adjoint(const double* w, double* g, string& err)
+{// the free rows of the network matrix are the node balances R(h,B) = A(B) h + Q = 0.
+	// for J = w.h, dJ/dB_t = -lambda^T dR/dB_t with A lambda = w (A is symmetric, so the
+	// forward factors serve). tube t adds B_t (h_a - h_b) to row a and its negative to
+	// row b, so dJ/dB_t = -(lambda_a - lambda_b)(h_a - h_b), and B goes with dia^4
+	phasetimer timer(stats, PHASE_SOLVE);
+	const int n = net.n_nodes;
+	vector<double> lambda(n);
+	for (int i = 0; i < n; i++)
+		lambda[i] = net.fixed[i] ? 0.0 : w[i]; //fixed heads do not move, lambda is 0 there
+	int sweeps;
+	if (!directsolve(lambda.data(), 1, sweeps))
 	{
-		vec_Q[i] = (-1)*vec_nodes[i]->getQ();//getQ belongs to class node
-											 //get the Q from the vec_nodes and multiplies it by -1 
-											 //so create the appropriate form of Ax=B >>> Bh=-Q
+		err = "the tube changes leave the network matrix singular";
+		return false;
 	}
+	for (int t = 0; t < net.n_tubes; t++)
+	{
+		if (net.B[t] == 0.0 || !(net.dia[t] > 0))
+		{// a removed tube stays closed whatever its diameter
+			g[t] = 0.0;
+			continue;
+		}
+		int a = net.n1[t], b = net.n2[t];
+		double dJdB = -(lambda[a] - lambda[b]) * (net.head[a] - net.head[b]);
+		g[t] = dJdB * 4.0 * net.B[t] / net.dia[t];
+	}
+	err.clear();
+	return true;
+}
 
-	//******************* Applying Boundary Conditions ************************//
-	vec_Q[0] = 0.0;
-	mtxB[0][0] = 1.0;
-	for (int i = 1; i < n_nodes; i++)
+bool pipenet::headgradient(const double* w, double* g, string& err)
+{
+	if (lossmodel != LAMINAR)
+	{
+		err = "sensitivities need the laminar head loss model";
+		return false;
+	}
+	if (!isfactorized())
+		factorize();
+	solve();
+	if (status == SOLVE_SINGULAR)
 	{
-		mtxB[0][i] = 0.0; //B elements at first row=0
-		mtxB[i][0] = 0.0; //B elements at first column=0
+		err = message;
+		return false;
+	}
+	return adjoint(w, g, err);
+}
 
+bool pipenet::minheadgradient(double* g, int& node, string& err)
+{// the minimum is the head of one node wherever that node stays the lowest; where two
+	// nodes tie it has no gradient, and this is the one of the node found first
+	if (lossmodel != LAMINAR)
+	{
+		err = "sensitivities need the laminar head loss model";
+		return false;
+	}
+	if (!isfactorized())
+		factorize();
+	solve();
+	if (status == SOLVE_SINGULAR)
+	{
+		err = message;
+		return false;
+	}
+	node = -1;
+	for (int i = 0; i < net.n_nodes; i++)
+		if (!net.fixed[i] && (node < 0 || net.head[i] < net.head[node])) node = i;
+	if (node < 0)
+	{
+		err = "every node has a fixed head";
+		return false;
 	}
-	// --- Boundary conditions
+	vector<double> w(net.n_nodes, 0.0);
+	w[node] = 1.0;
+	return adjoint(w.data(), g, err);
+}
+
+void pipenet::newtonsolve()
+{// Newton-Raphson on the node balances F(h) = Q + sum of tube flows leaving each node.
+	// the Jacobian is the network matrix with the tube derivatives dq/ddh in place of B,
+	// so its pattern never changes: it is analysed once, kept, and only refactored
+	const int n = net.n_nodes;
+	const int nt = net.n_tubes;
+	const vector<char>& fixed = net.fixed;
+	vector<double> g(nt);
 
-	// Solves the linear system of equations
-	Mtx GlobalB(n_nodes, mtxB); // Creates object GlobalB of Mtx Class  
-	Vcr VecQ(n_nodes, vec_Q); // Creates object VecQ of Vcr Class 
+	// writes the Laplacian with tube weights w into the Jacobian pattern
+	auto fill = [&](const double* w) {
+		double* val = jacobian->getsra();
+		for (int p = 0; p < jacobian->nnz(); p++) val[p] = 0.0;
+		for (int i = 0; i < n; i++)
+			if (fixed[i]) val[jacobian->find(i, i)] = 1.0;
+		const int* pos = jacpos.data();
+		for (int t = 0; t < nt; t++, pos += 4)
+		{
+			if (pos[0] >= 0) val[pos[0]] += w[t];
+			if (pos[1] >= 0) val[pos[1]] += w[t];
+			if (pos[2] >= 0) val[pos[2]] -= w[t];
+			if (pos[3] >= 0) val[pos[3]] -= w[t];
+		}
+	};
 
-	GlobalB.GaussElim(VecQ); // Calls Mtx Class member function GaussElim(Vcr& bb) 
+	if (jacobian == NULL)
+	{// symbolic analysis, once per boundary condition pattern
+		phasetimer assembly(stats, PHASE_ASSEMBLY);
+		jacobian = new SparseMtx(assemble());
+		jacpos.resize(4 * nt); //position of each tube entry, -1 if dropped
+		for (int t = 0; t < nt; t++)
+		{
+			int a = net.n1[t], b = net.n2[t];
+			jacpos[4 * t] = !fixed[a] ? jacobian->find(a, a) : -1;
+			jacpos[4 * t + 1] = !fixed[b] ? jacobian->find(b, b) : -1;
+			jacpos[4 * t + 2] = (!fixed[a] && !fixed[b]) ? jacobian->find(a, b) : -1;
+			jacpos[4 * t + 3] = (!fixed[a] && !fixed[b]) ? jacobian->find(b, a) : -1;
+		}
+		assembly.stop();
+		jacfactor = factorwithorder(*jacobian);
+	}
+
+	double qscale = 0.0;
+	for (int i = 0; i < n; i++) qscale = max(qscale, fabs(net.Q[i]));
+	if (qscale == 0.0) qscale = 1.0;
+
+	Vcr h(n);
+	if (solved)
+	{// warm start from the previous heads
+		for (int i = 0; i < n; i++) h[i] = net.head[i];
+	}
+	else
+	{// laminar heads as the starting point
+		phasetimer timer(stats, PHASE_FACTOR);
+		fill(net.B.data());
+		if (jacfactor->refactor(*jacobian) != 0)
+		{
+			report(SOLVE_SINGULAR, "network matrix is singular at node " + to_string(singularnode(jacfactor) + 1));
+			return;
+		}
+		timer.stop();
+		phasetimer solvetimer(stats, PHASE_SOLVE);
+		assembleQ(net.Q.data(), &h[0], 1);
+		jacfactor->solve(h);
+	}
+	Vcr r(n), dh(n), htry(n);
+
+	// flows, derivatives and node balances at heads x, returns max |F|
+	auto balance = [&](const Vcr& x, Vcr& res) {
+		for (int i = 0; i < n; i++) res[i] = net.Q[i];
+		for (int t = 0; t < nt; t++)
+		{
+			int a = net.n1[t], b = net.n2[t];
+			double q = tubeflow(lossmodel, x[a] - x[b], net.dia[t], net.length[t], net.B[t], roughness, g[t]);
+			net.q[t] = q;
+			res[a] += q;
+			res[b] -= q;
+		}
+		for (int i = 0; i < n; i++)
+			if (fixed[i]) res[i] = 0.0; //fixed heads take up any imbalance
+		return res.maxnorm();
+	};
+
+	double fnorm = balance(h, r);
+	double step = 0.0;
+	for (iterations = 0; iterations < newton_maxiter; iterations++)
+	{
+		if (fnorm <= newton_qtol * qscale && (iterations > 0 || solved) && step <= newton_htol * max(h.maxnorm(), 1.0))
+			break;
+		phasetimer timer(stats, PHASE_FACTOR);
+		fill(g.data());
+		if (jacfactor->refactor(*jacobian) != 0)
+		{
+			report(SOLVE_SINGULAR, "Newton Jacobian is singular at node " + to_string(singularnode(jacfactor) + 1));
+			break;
+		}
+		timer.stop();
+		phasetimer solvetimer(stats, PHASE_SOLVE);
+		for (int i = 0; i < n; i++) dh[i] = -r[i]; //J dh = -F
+		jacfactor->solve(dh);
+
+		// backtracking line search on max |F|
+		double lambda = 1.0;
+		double ftry;
+		for (;;)
+		{
+			htry = h + lambda * dh;
+			ftry = balance(htry, r);
+			if (ftry < fnorm || lambda < 1.0 / 64) break;
+			lambda *= 0.5;
+		}
+		swap(h, htry); //the storage changes hands, nothing is copied
+		fnorm = ftry;
+		step = lambda * dh.maxnorm();
+	}
+	residual = fnorm / qscale;
+	if (iterations >= newton_maxiter)
+	{
+		ostringstream m;
+		m << "Newton did not converge, relative flow imbalance " << residual << " after " << iterations << " iterations";
+		report(SOLVE_NOT_CONVERGED, m.str());
+	}
+	for (int i = 0; i < n; i++) net.head[i] = h[i];
+	balance(h, r); //flows at the final heads
+}
+
+void pipenet::countsolve()
+{
+	if (stats == NULL)
+		return;
+	stats->solves++;
+	stats->iterations = iterations;
+	stats->residual = residual;
+}
+
+void pipenet::solve()
+{
+	status = SOLVE_OK;
+	message.clear();
+	phasetimer boundary(stats, PHASE_BOUNDARY);
+	if (!isfactorized())
+		findcomponents(); //factorize() has done it already
+	boundary.stop();
+	if (lossmodel != LAMINAR)
+	{
+		newtonsolve();
+		solved = (status == SOLVE_OK); //a failed Newton solve is no warm start for the next one
+		countsolve();
+		return;
+	}
+	const int n_nodes = net.n_nodes;
+	 ////****************** Q vector *******************//
+	Vcr VecQ(n_nodes);
+	{
+		phasetimer timer(stats, PHASE_BOUNDARY);
+		assembleQ(net.Q.data(), &VecQ[0], 1);
+	}
+
+	// Solves the linear system of equations, the matrix is symmetric positive definite
+	Vcr VecH(n_nodes);
+	if (factor != NULL || schur != NULL)
+	{// direct solve with the factors from factorize()
+		phasetimer timer(stats, PHASE_SOLVE);
+		VecH = VecQ;
+		if (!directsolve(&VecH[0], 1, iterations))
+		{
+			report(SOLVE_SINGULAR, "network matrix is singular");
+			solved = false;
+			return;
+		}
+		Vcr r(n_nodes);
+		multiply(&VecH[0], &r[0], 1);
+		residual = (VecQ.twonorm() > 0) ? twonorm(r - VecQ) / VecQ.twonorm() : 0.0;
+	}
+	else if (n_comp > 1)
+	{// every component is a system of its own, they are solved in parallel
+		phasetimer assembly(stats, PHASE_ASSEMBLY);
+		SparseMtx B = assemble();
+		assembly.stop();
+		phasetimer timer(stats, PHASE_SOLVE);
+		const int* fnz = B.getfnz();
+		const int* clm = B.getclm();
+		const double* sra = B.getsra();
+		vector<vector<int> > members(n_comp);
+		vector<int> local(n_nodes);
+		for (int i = 0; i < n_nodes; i++)
+		{
+			local[i] = (int)members[comp[i]].size();
+			members[comp[i]].push_back(i);
+		}
+		vector<int> its(n_comp), cgstatus(n_comp);
+		vector<double> res(n_comp);
+		threadpool::shared().parallel_for(n_comp, [&](int k) {
+			const vector<int>& m = members[k];
+			const int nk = (int)m.size();
+			vector<int> ia, ja;
+			vector<double> a;
+			Vcr h(nk), q(nk);
+			for (int r = 0; r < nk; r++)
+			{
+				int i = m[r];
+				for (int p = fnz[i]; p < fnz[i + 1]; p++)
+				{
+					ia.push_back(r);
+					ja.push_back(local[clm[p]]);
+					a.push_back(sra[p]);
+				}
+				q[r] = VecQ[i];
+				h[r] = solved ? net.head[i] : 0.0; //warm start from the previous heads
+			}
+			SparseMtx Bk(nk, (int)a.size(), ia.data(), ja.data(), a.data());
+			res[k] = tol;
+			its[k] = (maxiter > 0) ? maxiter : 10 * nk;
+			if (precond == 3)
+			{// levels of this component only, not kept
+				AMGPrecond M(Bk);
+				cgstatus[k] = Bk.CG(h, q, res[k], its[k], M);
+			}
+			else
+				cgstatus[k] = Bk.CG(h, q, res[k], its[k], precond);
+			for (int r = 0; r < nk; r++) VecH[m[r]] = h[r];
+		});
+		iterations = 0;
+		residual = 0.0;
+		for (int k = 0; k < n_comp; k++)
+		{
+			iterations = max(iterations, its[k]);
+			residual = max(residual, res[k]);
+			if (cgstatus[k] != 0)
+			{
+				ostringstream m;
+				m << "CG did not converge on the component of node " << members[k][0] + 1 << ", relative residual " << res[k] << " after " << its[k] << " iterations";
+				report(SOLVE_NOT_CONVERGED, m.str());
+			}
+		}
+	}
+	else if (precond == 3)
+	{// multigrid: the matrix and its levels are kept for the next solves, tube changes
+		// only redo their values
+		if (amg == NULL || amgstale)
+		{
+			phasetimer assembly(stats, PHASE_ASSEMBLY);
+			if (amgB == NULL) amgB = new SparseMtx(assemble());
+			else *amgB = assemble();
+			assembly.stop();
+			phasetimer timer(stats, PHASE_FACTOR);
+			if (amg == NULL) amg = new AMGPrecond(*amgB);
+			else amg->refresh(*amgB);
+			amgstale = false;
+		}
+		if (solved) //warm start from the previous heads
+			for (int i = 0; i < n_nodes; i++) VecH[i] = net.head[i];
+		phasetimer timer(stats, PHASE_SOLVE);
+		residual = tol;
+		iterations = (maxiter > 0) ? maxiter : 10 * n_nodes;
+		if (amgB->CG(VecH, VecQ, residual, iterations, *amg) != 0)
+		{
+			ostringstream m;
+			m << "CG did not converge, relative residual " << residual << " after " << iterations << " iterations";
+			report(SOLVE_NOT_CONVERGED, m.str());
+		}
+	}
+	else
+	{
+		if (solved) //warm start from the previous heads
+			for (int i = 0; i < n_nodes; i++) VecH[i] = net.head[i];
+		phasetimer assembly(stats, PHASE_ASSEMBLY);
+		SparseMtx B = assemble();
+		assembly.stop();
+		phasetimer timer(stats, PHASE_SOLVE);
+		residual = tol;
+		iterations = (maxiter > 0) ? maxiter : 10 * n_nodes;
+		if (B.CG(VecH, VecQ, residual, iterations, precond) != 0)
+		{
+			ostringstream m;
+			m << "CG did not converge, relative residual " << residual << " after " << iterations << " iterations";
+			report(SOLVE_NOT_CONVERGED, m.str());
+		}
+	}
 
 	for (int i = 0; i < n_nodes; i++)
 	{
-		double h = VecQ.getvalues(i); // Get values of head
-		vec_nodes[i]->definehead(h); // Set values of head
+		net.head[i] = VecH[i]; // Set values of head
 	}
-	//**************Calculate and display flow****************//
-	// Calculates and displays tube flow using Tube member function displayflow()
-	for (int i = 0; i < n_tubes; i++)
 	{
-		vec_tubes[i]->displayflow();
+		phasetimer timer(stats, PHASE_OUTPUT);
+		net.calcflow();
 	}
+	solved = (status == SOLVE_OK); //unconverged heads are neither results nor a warm start
+	countsolve();
+}
+
+string pipenet::calcflowrate()
+{
+	solve();
+	//**************Display flow****************//
+	phasetimer timer(stats, PHASE_OUTPUT);
+	return formatflows(net.n_tubes, net.q.data()); //one string, written at once by the caller
+}
+
+bool pipenet::saveresults(const char* filename, string& err)
+{
+	if (!solved)
+		solve();
+	if (!solved)
+	{// nothing but converged heads is written as results
+		err = message;
+		return false;
+	}
+	phasetimer timer(stats, PHASE_OUTPUT);
+	return writeresults(filename, net.n_nodes, net.n_tubes, net.head.data(), net.Q.data(),
+		net.n1.data(), net.n2.data(), net.q.data(), err);
+}
+
+bool pipenet::savecsv(const char* nodefile, const char* tubefile, string& err)
+{
+	if (!solved)
+		solve();
+	if (!solved)
+	{// nothing but converged heads is written as results
+		err = message;
+		return false;
+	}
+	phasetimer timer(stats, PHASE_OUTPUT);
+	return writeresultscsv(nodefile, tubefile, net.n_nodes, net.n_tubes, net.head.data(), net.Q.data(),
+		net.n1.data(), net.n2.data(), net.q.data(), err);
 }
 pipenet::~pipenet()
 {
-	for (int i = 0; i < n_nodes; i++) { delete[] vec_nodes[i]; }
-	delete[] vec_nodes;
-	for (int i = 0; i < n_tubes; i++) { delete[] vec_tubes[i]; }
-	delete[] vec_tubes;
-}
\ No newline at end of file
+	dropfactors();
+}
@@ -0,0 +1,238 @@
+/*
+	schur.cpp
+	subdomain factorization and Schur complement on the interface
+*/
+#include <iostream>
+#include <vector>
+#include "MatVec.h"
+#include "ordering.h"
+#include "schur.h"
+#include "threadpool.h"
+
+using namespace std;
+
+void error(const char* t);							// in MatVec.cpp, throws MatVecError
+
+static const int SCHUR_NB = 16;						// interface columns per block solve
+
+// L D L^T of A in the given ordering
+static SparseLDL* ordered(const SparseMtx& A, int method, bool sp)
+{
+  if (method == ORDER_NATURAL) return new SparseLDL(A, 0, sp);
+  vector<int> perm(A.size());
+  fillorder(A, method, perm.data());
+  return new SparseLDL(A, perm.data(), sp);
+}
+
+SchurSolver::SchurSolver(const SparseMtx& A, int k, int method, bool sp)
+{
+  if (k < 1) k = 1;
+  vector<int> where(A.size());
+  graphpartition(A, k, where.data());
+  build(A, where, k, method, sp);
+}
+
+// with the connected components as parts there is no interface at all
+SchurSolver::SchurSolver(const SparseMtx& A, const int* part, int k, int method, bool sp)
+{
+  vector<int> where(part, part + A.size());
+  build(A, where, k, method, sp);
+}
+
+void SchurSolver::build(const SparseMtx& A, vector<int>& where, int k, int method, bool sp)
+{
+  n = A.size();
+  schur = 0;
+  singular = 0;
+  const int* fnz = A.getfnz();
+  const int* clm = A.getclm();
+  const double* sra = A.getsra();
+
+  // one end of every tube between two parts moves to the interface
+  for (int i = 0; i < n; i++) {
+    for (int p = fnz[i]; p < fnz[i + 1]; p++) {
+      int j = clm[p];
+      if (where[i] < 0) break;
+      if (where[j] < 0 || where[j] == where[i]) continue;
+      if (where[j] > where[i]) where[j] = -1;
+      else where[i] = -1;
+    }
+  }
+  vector<int> local(n);								// index in the subdomain or in gamma
+  sub.resize(k);
+  for (int i = 0; i < n; i++) {
+    if (where[i] < 0) {
+      local[i] = (int)gamma.size();
+      gamma.push_back(i);
+    }
+    else {
+      local[i] = (int)sub[where[i]].rows.size();
+      sub[where[i]].rows.push_back(i);
+    }
+  }
+  const int ng = (int)gamma.size();
+
+  // each subdomain: A_jj, its coupling to the interface, its factors and its
+  // dense block A_Gj A_jj^-1 A_jG of the Schur complement
+  vector<vector<double> > block(k);
+  threadpool::shared().parallel_for(k, [&](int j) {
+    subdomain& s = sub[j];
+    s.factor = 0;
+    const int nj = (int)s.rows.size();
+    if (nj == 0) return;
+    vector<int> ia, ja, slot(ng, -1);
+    vector<double> a;
+    for (int li = 0; li < nj; li++) {
+      int i = s.rows[li];
+      for (int p = fnz[i]; p < fnz[i + 1]; p++) {
+        int c = clm[p];
+        if (where[c] == j) {
+          ia.push_back(li);
+          ja.push_back(local[c]);
+          a.push_back(sra[p]);
+        }
+        else {										// an interface row, by construction
+          int g = local[c];
+          if (slot[g] < 0) {
+            slot[g] = (int)s.iface.size();
+            s.iface.push_back(g);
+          }
+          s.ci.push_back(li);
+          s.cg.push_back(slot[g]);
+          s.ca.push_back(sra[p]);
+        }
+      }
+    }
+    SparseMtx Ajj(nj, (int)a.size(), ia.data(), ja.data(), a.data());
+    s.factor = ordered(Ajj, method, sp);
+    if (s.factor->info() != 0) return;
+
+    const int m = (int)s.iface.size();
+    vector<double>& B = block[j];
+    B.assign((long)m*m, 0.0);
+    vector<double> X;
+    for (int c0 = 0; c0 < m; c0 += SCHUR_NB) {
+      const int nb = (m - c0 < SCHUR_NB) ? m - c0 : SCHUR_NB;
+      X.assign((long)nj*nb, 0.0);
+      for (size_t e = 0; e < s.ca.size(); e++)
+        if (s.cg[e] >= c0 && s.cg[e] < c0 + nb) X[(long)s.ci[e]*nb + s.cg[e] - c0] = s.ca[e];
+      s.factor->solve(X.data(), nb);
+      for (size_t e = 0; e < s.ca.size(); e++) {
+        double* row = &B[(long)s.cg[e]*m + c0];
+        const double* x = &X[(long)s.ci[e]*nb];
+        const double ae = s.ca[e];
+        for (int c = 0; c < nb; c++) row[c] += ae*x[c];
+      }
+    }
+  });
+  for (int j = 0; j < k; j++) {
+    SparseLDL* f = sub[j].factor;
+    if (f != 0 && f->info() != 0) {
+      int r = f->info() - 1;
+      singular = 1 + sub[j].rows[f->permutation() ? f->permutation()[r] : r];
+      return;
+    }
+  }
+  if (ng == 0) return;
+
+  // S = A_GG minus the subdomain blocks, summed by the triplet constructor
+  vector<int> ia, ja;
+  vector<double> a;
+  for (int g = 0; g < ng; g++) {
+    int i = gamma[g];
+    for (int p = fnz[i]; p < fnz[i + 1]; p++) {
+      if (where[clm[p]] >= 0) continue;
+      ia.push_back(g);
+      ja.push_back(local[clm[p]]);
+      a.push_back(sra[p]);
+    }
+  }
+  for (int j = 0; j < k; j++) {
+    const vector<int>& f = sub[j].iface;
+    const int m = (int)f.size();
+    for (int r = 0; r < m; r++)
+      for (int c = 0; c < m; c++) {
+        ia.push_back(f[r]);
+        ja.push_back(f[c]);
+        a.push_back(-block[j][(long)r*m + c]);
+      }
+    vector<double>().swap(block[j]);
+  }
+  SparseMtx S(ng, (int)a.size(), ia.data(), ja.data(), a.data());
+  schur = ordered(S, method, sp);
+  if (schur->info() != 0) {
+    int r = schur->info() - 1;
+    singular = 1 + gamma[schur->permutation() ? schur->permutation()[r] : r];
+  }
+}
+
+SchurSolver::~SchurSolver()
+{
+  for (size_t j = 0; j < sub.size(); j++) delete sub[j].factor;
+  delete schur;
+}
+
+long SchurSolver::nnz() const
+{
+  long total = schur ? schur->nnz() : 0;
+  for (size_t j = 0; j < sub.size(); j++)
+    if (sub[j].factor) total += sub[j].factor->nnz();
+  return total;
+}
+
+// solves A x = bb, x stored in bb
+void SchurSolver::solve(Vcr& bb) const
+{
+  if (n != bb.size()) error("matrix or vector sizes do not match");
+  solve(&bb[0], 1);
+}
+
+// block elimination: y_j = A_jj^-1 b_j in every subdomain, S x_G = b_G - sum A_Gj y_j
+// on the interface, then x_j = A_jj^-1 (b_j - A_jG x_G) in every subdomain again
+void SchurSolver::solve(double* bb, int nrhs) const
+{
+  if (singular != 0) error("solve with singular factors in SchurSolver::solve()");
+  const int k = (int)sub.size();
+  const int ng = (int)gamma.size();
+  vector<double> g((long)ng*nrhs);
+  for (int t = 0; t < ng; t++)
+    for (int r = 0; r < nrhs; r++) g[(long)t*nrhs + r] = bb[(long)gamma[t]*nrhs + r];
+
+  vector<vector<double> > part(k);					// A_Gj y_j on the interface of j
+  threadpool::shared().parallel_for(k, [&](int j) {
+    const subdomain& s = sub[j];
+    const int nj = (int)s.rows.size();
+    if (nj == 0 || s.iface.empty()) return;
+    vector<double> y((long)nj*nrhs);
+    for (int li = 0; li < nj; li++)
+      for (int r = 0; r < nrhs; r++) y[(long)li*nrhs + r] = bb[(long)s.rows[li]*nrhs + r];
+    s.factor->solve(y.data(), nrhs);
+    vector<double>& c = part[j];
+    c.assign(s.iface.size()*nrhs, 0.0);
+    for (size_t e = 0; e < s.ca.size(); e++)
+      for (int r = 0; r < nrhs; r++) c[(long)s.cg[e]*nrhs + r] += s.ca[e]*y[(long)s.ci[e]*nrhs + r];
+  });
+  for (int j = 0; j < k; j++) {
+    const vector<int>& f = sub[j].iface;
+    for (size_t t = 0; t < part[j].size(); t++)
+      g[(long)f[t/nrhs]*nrhs + t%nrhs] -= part[j][t];
+  }
+  if (ng > 0) schur->solve(g.data(), nrhs);
+
+  threadpool::shared().parallel_for(k, [&](int j) {
+    const subdomain& s = sub[j];
+    const int nj = (int)s.rows.size();
+    if (nj == 0) return;
+    vector<double> y((long)nj*nrhs);
+    for (int li = 0; li < nj; li++)
+      for (int r = 0; r < nrhs; r++) y[(long)li*nrhs + r] = bb[(long)s.rows[li]*nrhs + r];
+    for (size_t e = 0; e < s.ca.size(); e++)
+      for (int r = 0; r < nrhs; r++)
+        y[(long)s.ci[e]*nrhs + r] -= s.ca[e]*g[(long)s.iface[s.cg[e]]*nrhs + r];
+    s.factor->solve(y.data(), nrhs);
+    for (int li = 0; li < nj; li++)
+      for (int r = 0; r < nrhs; r++) bb[(long)s.rows[li]*nrhs + r] = y[(long)li*nrhs + r];
+  });
+  for (int t = 0; t < ng; t++)
+    for (int r = 0; r < nrhs; r++) bb[(long)gamma[t]*nrhs + r] = g[(long)t*nrhs + r];
+}
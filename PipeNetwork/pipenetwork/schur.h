@@ -0,0 +1,65 @@
+/*
+	schur.h
+	Direct solver over subdomains of the network and the interface between them
+*/
+#ifndef SCHUR_H_
+#define SCHUR_H_
+#include <vector>
+#include "ordering.h"
+
+template<class T> class Vector;
+typedef Vector<double> Vcr;
+class SparseMtx;
+class SparseLDL;
+
+//---------------------------------------------------------------------------------
+// CLASS SchurSolver
+//---------------------------------------------------------------------------------
+// the rows of A are split into k subdomains and the interface rows that
+// separate them. with the interface last A is
+//     [ A_11           A_1G ]
+//     [       ...       ... ]
+//     [           A_kk A_kG ]
+//     [ A_G1 ...  A_Gk A_GG ]
+// and the subdomain blocks are factored independently. the interface unknowns
+// solve the Schur complement S = A_GG - sum A_Gj A_jj^-1 A_jG, a sparse matrix
+// of one dense block per subdomain
+class SchurSolver {
+
+private:
+  struct subdomain {
+    std::vector<int> rows;							// rows of A, in local order
+    std::vector<int> iface;							// interface unknowns it touches
+    std::vector<int> ci, cg;						// A_jG: local row, index into iface,
+    std::vector<double> ca;							// value
+    SparseLDL* factor;								// L D L^T of A_jj
+  };
+  int n;											// dimension of A
+  std::vector<subdomain> sub;
+  std::vector<int> gamma;							// interface rows of A
+  SparseLDL* schur;									// factors of S, 0 if no interface
+  int singular;										// 0, or 1 + row of A of a zero pivot
+
+  void build(const SparseMtx& A, std::vector<int>& where, int k, int method, bool sp);
+
+public:
+  SchurSolver(const SparseMtx& A, int k, int method = ORDER_AMD, bool sp = false);
+													// A symmetric, k subdomains, ordering
+													// of the factors, factors in single
+													// precision (see SparseLDL)
+  SchurSolver(const SparseMtx& A, const int* part, int k, int method = ORDER_AMD,
+              bool sp = false);						// subdomains given, part[i] in [0,k)
+  SchurSolver(const SchurSolver&) = delete;
+  SchurSolver& operator=(const SchurSolver&) = delete;
+  ~SchurSolver();
+
+  int size() const { return n; }					// dimension of A
+  int parts() const { return (int)sub.size(); }		// number of subdomains
+  int interface() const { return (int)gamma.size(); }	// number of interface rows
+  long nnz() const;									// entries of all the L factors
+  int info() const { return singular; }				// 0 if the factors can be used
+  void solve(Vcr& bb) const;						// solves A x = bb, x stored in bb
+  void solve(double* bb, int nrhs) const;			// nrhs right sides, entry i of right
+													// side r is bb[i*nrhs + r]
+};
+#endif
@@ -1,25 +1,76 @@
+// Command line front end of the pipenetwork library.
+// usage: pipenet [network file (default pipedata.txt)] [--report=timings.json]
+//        [--csv=nodes.csv,tubes.csv]
+// exit code 0, 1 if a file cannot be read or written, 2 if the solve did not succeed
+#include <cstring>
+#include <exception>
 #include <iostream>
-#include <cstdlib>
-#include <fstream>
 #include <string>
 #include "classes.h"
+#include "netio.h"
+#include "telemetry.h"
 
 using namespace std;
 
-int main()
+int main(int argc, char** argv)
 {  
 
 	cout<<"****Pipe Network for Bavaria*******"<<"\n";
 	cout<<"***********Fatemeh Paknejad*********"<<"\n";
 
-   
-	ifstream infile("pipedata.txt");
+	const char* input = "pipedata.txt";
+	const char* report = NULL; //phase timings as JSON
+	string nodecsv, tubecsv;
+	for (int k = 1; k < argc; k++)
+	{
+		if (strncmp(argv[k], "--report=", 9) == 0) report = argv[k] + 9;
+		else if (strncmp(argv[k], "--csv=", 6) == 0)
+		{
+			string files = argv[k] + 6;
+			size_t comma = files.find(',');
+			nodecsv = files.substr(0, comma);
+			tubecsv = (comma == string::npos) ? "" : files.substr(comma + 1);
+		}
+		else if (argv[k][0] != '-') input = argv[k];
+		else
+		{
+			cerr<<"usage: pipenet [network file] [--report=timings.json] [--csv=nodes.csv,tubes.csv]\n";
+			return 1;
+		}
+	}
 
-	pipenet bavarian(infile);
-	bavarian.calcflowrate();
+	try
+	{
+		solvestats stats; //timings are taken only when a report file is named
+		solvestats* timing = report ? &stats : NULL;
+		netdata net;
+		string err;
+		if (!readnetwork(input, net, err, timing))
+		{
+			cerr<<err<<"\n";
+			return 1;
+		}
 
-	infile.close();
-
-	system("PAUSE");
-	return 0;
-}
\ No newline at end of file
+		pipenet bavarian(net, timing);
+		bavarian.setlog(&cout); //solver notes between the results
+		cout<<bavarian.calcflowrate();
+		cout<<"PCG iterations--  "<<bavarian.getiterations()<<"\t"<<"relative residual--  "<<bavarian.getresidual()<<"\n";
+		int code = (bavarian.getstatus() == SOLVE_OK) ? 0 : 2;
+		if (!nodecsv.empty() && !bavarian.savecsv(nodecsv.c_str(), tubecsv.empty() ? NULL : tubecsv.c_str(), err))
+		{
+			cerr<<err<<"\n";
+			if (code == 0) code = 1; //a failed solve is reported first
+		}
+		if (timing && !stats.writejson(report, err))
+		{
+			cerr<<err<<"\n";
+			if (code == 0) code = 1; //a failed solve is reported first
+		}
+		return code;
+	}
+	catch (const exception& e)
+	{
+		cerr<<e.what()<<"\n";
+		return 1;
+	}
+}
@@ -0,0 +1,240 @@
+//Spatial index over the nodes and tubes of a network
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include "spatial.h"
+#include "netio.h"
+#include "threadpool.h"
+
+namespace
+{
+const int FANOUT = 16; //children of every box, a leaf level box holds 16 items
+
+//squared distance from a point to a box, 0 inside
+inline double boxdistance2(double x0, double y0, double x1, double y1, double x, double y)
+{
+	double dx = max(max(x0 - x, x - x1), 0.0);
+	double dy = max(max(y0 - y, y - y1), 0.0);
+	return dx * dx + dy * dy;
+}
+
+struct candidate
+{
+	double d; //squared distance, exact at the leaves and a lower bound above them
+	int at; //box in rtree::boxes
+	int lvl;
+	bool operator>(const candidate& o) const { return d > o.d || (d == o.d && at > o.at); }
+};
+}
+
+/********************************************************/
+//Building
+
+void spatialindex::load(rtree& t, const vector<box>& items)
+{// sort-tile-recursive: the items are sorted by the x of their centres and cut into
+	// about sqrt(leaves) vertical slices, each slice is sorted by y and cut into leaves.
+	// every level above packs FANOUT consecutive boxes of the one below
+	int n = (int)items.size();
+	vector<pair<double,int> > key(n); //centre coordinate (doubled) and item, sorted in place
+	for (int i = 0; i < n; i++) key[i] = make_pair(items[i].x0 + items[i].x1, i);
+	sort(key.begin(), key.end());
+	for (int i = 0; i < n; i++) key[i].first = items[key[i].second].y0 + items[key[i].second].y1;
+	int leaves = (n + FANOUT - 1) / FANOUT;
+	int slices = (int)ceil(sqrt((double)leaves));
+	int per = slices > 0 ? FANOUT * ((leaves + slices - 1) / slices) : 0; //items of a slice
+	threadpool::shared().parallel_for(slices, [&](int s) {
+		sort(key.begin() + min(s * per, n), key.begin() + min((s + 1) * per, n));
+	});
+	t.id.resize(n);
+	for (int i = 0; i < n; i++) t.id[i] = key[i].second;
+
+	t.boxes.clear();
+	t.boxes.reserve(n + n / (FANOUT - 1) + 2);
+	for (int i = 0; i < n; i++) t.boxes.push_back(items[t.id[i]]);
+	t.level.assign(1, 0);
+	while ((int)t.boxes.size() - t.level.back() > 1)
+	{
+		int lo = t.level.back(), hi = (int)t.boxes.size();
+		t.level.push_back(hi);
+		for (int k = lo; k < hi; k += FANOUT)
+		{
+			box b = t.boxes[k];
+			for (int c = k + 1; c < min(k + FANOUT, hi); c++)
+			{
+				const box& e = t.boxes[c];
+				b.x0 = min(b.x0, e.x0); b.y0 = min(b.y0, e.y0);
+				b.x1 = max(b.x1, e.x1); b.y1 = max(b.y1, e.y1);
+			}
+			t.boxes.push_back(b);
+		}
+	}
+	t.level.push_back((int)t.boxes.size());
+}
+
+spatialindex::spatialindex(int n_nodes, const double* x, const double* y, int n_tubes, const int* n1, const int* n2)
+{
+	vector<box> items(n_nodes);
+	for (int i = 0; i < n_nodes; i++) items[i] = box{x[i], y[i], x[i], y[i]};
+	load(nodetree, items);
+	items.resize(n_tubes);
+	for (int t = 0; t < n_tubes; t++)
+	{
+		int a = n1[t], b = n2[t];
+		items[t] = box{min(x[a], x[b]), min(y[a], y[b]), max(x[a], x[b]), max(y[a], y[b])};
+	}
+	load(tubetree, items);
+	segment.resize(n_tubes);
+	for (int k = 0; k < n_tubes; k++)
+	{
+		int t = tubetree.id[k];
+		segment[k] = box{x[n1[t]], y[n1[t]], x[n2[t]], y[n2[t]]};
+	}
+}
+
+spatialindex::spatialindex(const netcore& net)
+	:spatialindex(net.n_nodes, net.x.data(), net.y.data(), net.n_tubes, net.n1.data(), net.n2.data())
+{
+}
+
+spatialindex::spatialindex(const netdata& net)
+	:spatialindex(net.n_nodes, net.x.data(), net.y.data(), net.n_tubes, net.n1.data(), net.n2.data())
+{
+}
+
+/********************************************************/
+//Queries
+
+template<class F> void spatialindex::search(const rtree& t, const box& q, F f)
+{
+	if (t.boxes.empty()) return;
+	vector<pair<int,int> > stack(1, make_pair((int)t.boxes.size() - 1, (int)t.level.size() - 2)); //box, level
+	while (!stack.empty())
+	{
+		int at = stack.back().first, lvl = stack.back().second;
+		stack.pop_back();
+		const box& b = t.boxes[at];
+		if (b.x0 > q.x1 || b.x1 < q.x0 || b.y0 > q.y1 || b.y1 < q.y0) continue;
+		if (lvl == 0) { f(at); continue; }
+		int first = t.level[lvl - 1] + (at - t.level[lvl]) * FANOUT;
+		int last = min(first + FANOUT, t.level[lvl]);
+		for (int c = first; c < last; c++) stack.push_back(make_pair(c, lvl - 1));
+	}
+}
+
+template<class D> int spatialindex::nearest(const rtree& t, double x, double y, int k, int* out, double* dist, D d)
+{// best first: the closest box or leaf is taken next, a leaf that comes out is nearer
+	// than everything still waiting
+	if (t.boxes.empty() || k <= 0) return 0;
+	priority_queue<candidate, vector<candidate>, greater<candidate> > queue;
+	int top = (int)t.level.size() - 2;
+	const box& root = t.boxes.back();
+	queue.push(candidate{top == 0 ? d(0) : boxdistance2(root.x0, root.y0, root.x1, root.y1, x, y), (int)t.boxes.size() - 1, top});
+	int found = 0;
+	while (!queue.empty() && found < k)
+	{
+		candidate c = queue.top();
+		queue.pop();
+		if (c.lvl == 0)
+		{
+			out[found] = t.id[c.at];
+			if (dist) dist[found] = sqrt(c.d);
+			found++;
+			continue;
+		}
+		int first = t.level[c.lvl - 1] + (c.at - t.level[c.lvl]) * FANOUT;
+		int last = min(first + FANOUT, t.level[c.lvl]);
+		for (int e = first; e < last; e++)
+		{
+			const box& b = t.boxes[e];
+			queue.push(candidate{c.lvl == 1 ? d(e) : boxdistance2(b.x0, b.y0, b.x1, b.y1, x, y), e, c.lvl - 1});
+		}
+	}
+	return found;
+}
+
+double spatialindex::tubedistance2(int leaf, double x, double y) const
+{
+	const box& s = segment[leaf];
+	double dx = s.x1 - s.x0, dy = s.y1 - s.y0;
+	double len2 = dx * dx + dy * dy;
+	double u = len2 > 0.0 ? ((x - s.x0) * dx + (y - s.y0) * dy) / len2 : 0.0;
+	u = min(max(u, 0.0), 1.0);
+	double ex = s.x0 + u * dx - x, ey = s.y0 + u * dy - y;
+	return ex * ex + ey * ey;
+}
+
+bool spatialindex::tubecrosses(int leaf, const box& q) const
+{// Liang-Barsky: the part of the segment inside each of the four half planes of the box
+	// is cut down to [u0,u1], the tube crosses the box if something is left
+	const box& s = segment[leaf];
+	double dx = s.x1 - s.x0, dy = s.y1 - s.y0;
+	double u0 = 0.0, u1 = 1.0;
+	const double p[4] = {-dx, dx, -dy, dy};
+	const double r[4] = {s.x0 - q.x0, q.x1 - s.x0, s.y0 - q.y0, q.y1 - s.y0};
+	for (int k = 0; k < 4; k++)
+	{
+		if (p[k] == 0.0)
+		{
+			if (r[k] < 0.0) return false; //parallel to this side and outside it
+			continue;
+		}
+		double u = r[k] / p[k];
+		if (p[k] < 0.0) u0 = max(u0, u);
+		else u1 = min(u1, u);
+		if (u0 > u1) return false;
+	}
+	return true;
+}
+
+int spatialindex::nearestnodes(double x, double y, int k, int* nodes, double* dist) const
+{
+	const vector<box>& b = nodetree.boxes;
+	return nearest(nodetree, x, y, k, nodes, dist, [&](int leaf) {
+		double dx = b[leaf].x0 - x, dy = b[leaf].y0 - y;
+		return dx * dx + dy * dy;
+	});
+}
+
+int spatialindex::nearesttubes(double x, double y, int k, int* tubes, double* dist) const
+{
+	return nearest(tubetree, x, y, k, tubes, dist, [&](int leaf) { return tubedistance2(leaf, x, y); });
+}
+
+void spatialindex::nodesinbox(double xmin, double ymin, double xmax, double ymax, vector<int>& out) const
+{
+	size_t first = out.size();
+	search(nodetree, box{xmin, ymin, xmax, ymax}, [&](int leaf) { out.push_back(nodetree.id[leaf]); });
+	sort(out.begin() + first, out.end());
+}
+
+void spatialindex::tubesinbox(double xmin, double ymin, double xmax, double ymax, vector<int>& out) const
+{
+	size_t first = out.size();
+	box q = {xmin, ymin, xmax, ymax};
+	search(tubetree, q, [&](int leaf) {
+		if (tubecrosses(leaf, q)) out.push_back(tubetree.id[leaf]);
+	});
+	sort(out.begin() + first, out.end());
+}
+
+void spatialindex::nodesinpolygon(int m, const double* px, const double* py, vector<int>& out) const
+{// the nodes of the polygon's bounding box, kept if a ray from them to +x crosses an odd
+	// number of its sides
+	if (m < 3) return;
+	box q = {px[0], py[0], px[0], py[0]};
+	for (int i = 1; i < m; i++)
+	{
+		q.x0 = min(q.x0, px[i]); q.y0 = min(q.y0, py[i]);
+		q.x1 = max(q.x1, px[i]); q.y1 = max(q.y1, py[i]);
+	}
+	size_t first = out.size();
+	search(nodetree, q, [&](int leaf) {
+		double x = nodetree.boxes[leaf].x0, y = nodetree.boxes[leaf].y0;
+		bool inside = false;
+		for (int i = 0, j = m - 1; i < m; j = i++)
+			if ((py[i] > y) != (py[j] > y) && x < px[j] + (y - py[j]) * (px[i] - px[j]) / (py[i] - py[j]))
+				inside = !inside;
+		if (inside) out.push_back(nodetree.id[leaf]);
+	});
+	sort(out.begin() + first, out.end());
+}
@@ -0,0 +1,53 @@
+/*
+	spatial.h
+	Spatial index over the nodes and tubes of a network: nearest and region queries
+*/
+#ifndef SPATIAL_H_
+#define SPATIAL_H_
+#include <vector>
+#include "classes.h"
+
+//CLASS SPATIALINDEX: two packed R-trees, one over the node points and one over the tube
+//segments, bulk loaded once by sort-tile-recursive. a query descends only the boxes that
+//can hold an answer, O(log n) for a nearest node and O(log n + answers) for a box.
+//the index keeps its own copy of the coordinates; queries are const and any number of
+//threads may run them at once. nodes and tubes are 0-based
+class spatialindex
+{
+private:
+	struct box { double x0, y0, x1, y1; }; //lower left, upper right corner
+	struct rtree
+	{
+		vector<box> boxes; //leaves in tree order, then every level above them, root last
+		vector<int> level; //first box of each level, leaves at 0, and the end
+		vector<int> id; //node or tube of each leaf
+	};
+	rtree nodetree, tubetree;
+	vector<box> segment; //ends of each tube in tubetree leaf order: (x0,y0) to (x1,y1)
+
+	static void load(rtree&, const vector<box>&); //sorts the items into leaves, builds the levels
+	template<class F> static void search(const rtree&, const box&, F); //f(leaf) for every leaf touching the box
+	template<class D> static int nearest(const rtree&, double, double, int, int*, double*, D); //k nearest
+		//leaves by the exact distance d(leaf)
+	double tubedistance2(int, double, double) const; //squared distance of a point to a tubetree leaf
+	bool tubecrosses(int, const box&) const; //tubetree leaf has a point inside the box
+public:
+	spatialindex(int n_nodes, const double* x, const double* y, int n_tubes, const int* n1, const int* n2);
+	spatialindex(const netcore&);
+	spatialindex(const netdata&);
+	int nodes() const { return (int)nodetree.id.size(); }
+	int tubes() const { return (int)tubetree.id.size(); }
+
+	//the k nodes/tubes nearest to (x,y), nearest first, with their distances if dist is not
+	//NULL; returns how many were found, fewer than k only if the network has fewer
+	int nearestnodes(double x, double y, int k, int* nodes, double* dist = NULL) const;
+	int nearesttubes(double x, double y, int k, int* tubes, double* dist = NULL) const;
+	//nodes in the box, edges included, and tubes with a part of their length in it;
+	//appended to out in ascending order
+	void nodesinbox(double xmin, double ymin, double xmax, double ymax, vector<int>& out) const;
+	void tubesinbox(double xmin, double ymin, double xmax, double ymax, vector<int>& out) const;
+	//nodes inside the polygon of m corners (px[i],py[i]), closed from the last corner back
+	//to the first, by the even-odd rule; appended in ascending order
+	void nodesinpolygon(int m, const double* px, const double* py, vector<int>& out) const;
+};
+#endif
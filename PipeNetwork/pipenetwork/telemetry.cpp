@@ -0,0 +1,90 @@
+//Phase timings and solver metrics
+#include <cmath>
+#include <cstdio>
+#include "telemetry.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+static const char* PHASE_NAMES[PHASE_COUNT] = {
+	"parse", "geometry", "assembly", "boundary", "ordering", "factor", "solve", "output"
+};
+
+const char* phasename(int phase)
+{
+	return (phase >= 0 && phase < PHASE_COUNT) ? PHASE_NAMES[phase] : "unknown";
+}
+
+void solvestats::clear()
+{
+	for (int p = 0; p < PHASE_COUNT; p++)
+	{
+		seconds[p] = 0.0;
+		calls[p] = 0;
+	}
+	peakmemory = 0;
+	factorentries = 0;
+	solves = 0;
+	iterations = 0;
+	residual = 0.0;
+	condition = 0.0;
+}
+
+void solvestats::sample()
+{
+#ifndef _WIN32
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+#ifdef __APPLE__
+		peakmemory = (long)ru.ru_maxrss; //bytes on macOS
+#else
+		peakmemory = (long)ru.ru_maxrss * 1024; //kilobytes on Linux
+#endif
+#endif
+}
+
+// JSON has no inf or nan
+static string number(double v)
+{
+	if (!isfinite(v)) return "null";
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.9g", v);
+	return buf;
+}
+
+string solvestats::json() const
+{
+	solvestats s = *this;
+	s.sample();
+	string out = "{\n  \"phases\": {";
+	char buf[160];
+	for (int p = 0; p < PHASE_COUNT; p++)
+	{
+		snprintf(buf, sizeof(buf), "%s\n    \"%s\": {\"seconds\": %.9g, \"calls\": %ld}",
+			p ? "," : "", PHASE_NAMES[p], s.seconds[p], s.calls[p]);
+		out += buf;
+	}
+	snprintf(buf, sizeof(buf), "\n  },\n  \"peak_memory_bytes\": %ld,\n  \"factor_entries\": %ld,\n  \"solves\": %d,\n",
+		s.peakmemory, s.factorentries, s.solves);
+	out += buf;
+	snprintf(buf, sizeof(buf), "  \"iterations\": %d,\n  \"residual\": ", s.iterations);
+	out += buf + number(s.residual) + ",\n  \"condition_estimate\": " + number(s.condition) + "\n}\n";
+	return out;
+}
+
+bool solvestats::writejson(const char* filename, string& err) const
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+	{
+		err = string(filename) + ": cannot write file";
+		return false;
+	}
+	string s = json();
+	bool ok = fwrite(s.data(), 1, s.size(), f) == s.size();
+	if (fclose(f) != 0) ok = false;
+	if (!ok) err = string(filename) + ": write failed";
+	return ok;
+}
@@ -0,0 +1,73 @@
+/*
+	telemetry.h
+	Phase timings and solver metrics of a pipe network solve
+*/
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+#include <chrono>
+#include <string>
+
+enum solvephase
+{
+	PHASE_PARSE = 0, //reading the network file
+	PHASE_GEOMETRY, //tube lengths and B coefficients (calclength, calcB)
+	PHASE_ASSEMBLY, //network matrix
+	PHASE_BOUNDARY, //components, fixed heads and right sides
+	PHASE_ORDERING, //fill-reducing ordering
+	PHASE_FACTOR, //numeric factorization
+	PHASE_SOLVE, //triangular solves, CG or Newton iterations
+	PHASE_OUTPUT, //tube flows and printed results
+	PHASE_COUNT
+};
+
+const char* phasename(int); //"parse", "geometry", ...
+
+//filled in by whatever a solvestats is passed to: readnetwork(), pipenet, extperiod
+struct solvestats
+{
+	double seconds[PHASE_COUNT]; //wall time spent in each phase, summed over calls
+	long calls[PHASE_COUNT]; //times each phase ran
+	long peakmemory; //peak resident set size of the process, bytes, 0 where unknown
+	long factorentries; //entries of L of the last factorization
+	int solves; //solve() calls
+	int iterations; //of the last solve: CG iterations, refinement sweeps or Newton steps
+	double residual; //relative residual ||b - A x|| / ||b|| of the last solve
+	double condition; //1-norm condition estimate of the last factorized matrix, 0 if none
+
+	solvestats() { clear(); }
+	void clear();
+	void sample(); //peakmemory from the operating system
+	std::string json() const; //one JSON object, peak memory sampled first
+	bool writejson(const char*, std::string&) const; //file, error message
+};
+
+//adds the wall time of its scope to one phase. a NULL solvestats costs a pointer
+//test and no clock reads; built with PIPENET_NO_TELEMETRY it is an empty object
+class phasetimer
+{
+#ifndef PIPENET_NO_TELEMETRY
+	solvestats* stats;
+	int phase;
+	std::chrono::steady_clock::time_point start;
+public:
+	phasetimer(solvestats* s, int p) :stats(s), phase(p)
+	{
+		if (stats) start = std::chrono::steady_clock::now();
+	}
+	~phasetimer() { stop(); }
+	void stop() //ends the phase before the scope does
+	{
+		if (!stats) return;
+		stats->seconds[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats->calls[phase]++;
+		stats = NULL;
+	}
+#else
+public:
+	phasetimer(solvestats*, int) {}
+	void stop() {}
+#endif
+	phasetimer(const phasetimer&) = delete;
+	phasetimer& operator=(const phasetimer&) = delete;
+};
+#endif
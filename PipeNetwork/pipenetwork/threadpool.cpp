@@ -0,0 +1,160 @@
+/*
+	threadpool.cpp
+	implementation of the class threadpool
+*/
+#include <atomic>
+#include <exception>
+#include "threadpool.h"
+
+using namespace std;
+
+// a parallel loop: every thread taking part owns a slot with a range of indices,
+// a contiguous share of [0,n) to begin with. it takes indices from the front of
+// its range and, once that is empty, steals the back half of another slot's range.
+// the first exception a body throws is kept, the indices left are skipped, and the
+// caller of parallel_for gets it once every thread is out of the loop
+struct threadpool::loop {
+  struct range {
+    mutex lock;
+    int begin, end;
+  };
+  const function<void(int, int)>* body;
+  int n;
+  int slots;
+  unique_ptr<range[]> ranges;
+  atomic<int> joined;								// slots handed out
+  atomic<int> done;									// indices finished
+  atomic<bool> failed;								// a body has thrown
+  exception_ptr error;								// the first exception, under lock
+  mutex lock;
+  condition_variable finished;
+};
+
+threadpool::threadpool(int n) : stopping(false)
+{
+  if (n <= 0) {
+    n = (int)thread::hardware_concurrency() - 1;
+    if (n < 0) n = 0;
+  }
+  for (int i = 0; i < n; i++) workers.emplace_back(&threadpool::work, this);
+}
+
+threadpool::~threadpool()
+{
+  {
+    lock_guard<mutex> g(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+threadpool& threadpool::shared()
+{
+  static threadpool pool;
+  return pool;
+}
+
+void threadpool::run(loop& l)
+{
+  int slot = l.joined.fetch_add(1);
+  if (slot >= l.slots) return;						// every index is taken care of
+  loop::range& own = l.ranges[slot];
+  for (;;) {
+    int i = -1;
+    {
+      lock_guard<mutex> g(own.lock);
+      if (own.begin < own.end) i = own.begin++;
+    }
+    if (i < 0) {									// steal half of the largest range left
+      int victim = -1, most = 0;
+      for (int s = 1; s < l.slots; s++) {
+        loop::range& r = l.ranges[(slot + s) % l.slots];
+        lock_guard<mutex> g(r.lock);
+        if (r.end - r.begin > most) { most = r.end - r.begin; victim = (slot + s) % l.slots; }
+      }
+      if (victim < 0) return;
+      loop::range& r = l.ranges[victim];
+      int b, e;
+      {
+        lock_guard<mutex> g(r.lock);
+        if (r.begin >= r.end) continue;				// emptied meanwhile, look again
+        e = r.end;
+        b = r.end - (r.end - r.begin + 1)/2;
+        r.end = b;
+      }
+      lock_guard<mutex> g(own.lock);
+      i = b;
+      own.begin = b + 1;
+      own.end = e;
+    }
+    if (!l.failed.load()) {
+      try {
+        (*l.body)(i, slot);
+      }
+      catch (...) {
+        lock_guard<mutex> g(l.lock);
+        if (!l.error) l.error = current_exception();
+        l.failed = true;
+      }
+    }
+    if (l.done.fetch_add(1) + 1 == l.n) {
+      lock_guard<mutex> g(l.lock);
+      l.finished.notify_all();
+    }
+  }
+}
+
+void threadpool::work()
+{
+  for (;;) {
+    shared_ptr<loop> l;
+    {
+      unique_lock<mutex> g(lock);
+      wake.wait(g, [this] { return stopping || !queue.empty(); });
+      if (queue.empty()) return;					// stopping and nothing left
+      l = queue.front();
+      queue.pop_front();
+    }
+    run(*l);
+  }
+}
+
+void threadpool::parallel_for(int n, const function<void(int)>& body)
+{
+  parallel_for(n, [&body](int i, int) { body(i); });
+}
+
+void threadpool::parallel_for(int n, const function<void(int, int)>& body)
+{
+  if (n <= 0) return;
+  if (n == 1 || workers.empty()) {
+    for (int i = 0; i < n; i++) body(i, 0);
+    return;
+  }
+  int helpers = (n - 1 < (int)workers.size()) ? n - 1 : (int)workers.size();
+  shared_ptr<loop> l = make_shared<loop>();
+  l->body = &body;
+  l->n = n;
+  l->slots = helpers + 1;
+  l->ranges.reset(new loop::range [l->slots]);
+  for (int s = 0; s < l->slots; s++) {
+    l->ranges[s].begin = (int)((long)n*s/l->slots);
+    l->ranges[s].end = (int)((long)n*(s + 1)/l->slots);
+  }
+  l->joined = 0;
+  l->done = 0;
+  l->failed = false;
+  {
+    lock_guard<mutex> g(lock);
+    for (int h = 0; h < helpers; h++) queue.push_back(l);
+  }
+  if (helpers == 1) wake.notify_one();
+  else wake.notify_all();
+
+  run(*l);											// the caller works too, so nested
+													// loops never wait on a busy pool
+  unique_lock<mutex> g(l->lock);
+  l->finished.wait(g, [&] { return l->done.load() == n; });
+  if (l->error) rethrow_exception(l->error);
+}
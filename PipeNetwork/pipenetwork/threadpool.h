@@ -0,0 +1,51 @@
+/*
+	threadpool.h
+	A fixed set of worker threads that run parallel loops by work stealing
+*/
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------------------------
+// CLASS threadpool
+//---------------------------------------------------------------------------------
+class threadpool {
+
+private:
+  struct loop;										// one parallel_for in flight
+  std::vector<std::thread> workers;
+  std::deque<std::shared_ptr<loop> > queue;			// loops waiting for helpers
+  std::mutex lock;
+  std::condition_variable wake;
+  bool stopping;
+
+  void work();										// body of a worker thread
+  static void run(loop&);							// works through its own range of a loop,
+													// then steals from the others
+
+public:
+  explicit threadpool(int n = 0);					// n worker threads, 0: one less than
+													// the hardware threads
+  threadpool(const threadpool&) = delete;
+  threadpool& operator=(const threadpool&) = delete;
+  ~threadpool();
+
+  int size() const { return (int)workers.size() + 1; }	// threads taking part in a loop,
+													// the calling thread included
+  void parallel_for(int n, const std::function<void(int)>& body);	// body(i) for i in [0,n),
+													// returns when all calls are done; the
+													// first exception of a body is thrown
+													// on, the indices after it are skipped
+  void parallel_for(int n, const std::function<void(int, int)>& body);	// body(i, slot):
+													// slot in [0,size()) is unique among
+													// the threads running the loop, an
+													// index for per-thread scratch space
+  static threadpool& shared();						// pool shared by the whole process
+};
+#endif
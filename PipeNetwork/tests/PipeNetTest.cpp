@@ -0,0 +1,865 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "classes.h"
+#include "contingency.h"
+#include "extperiod.h"
+#include "headloss.h"
+#include "MatVec.h"
+#include "netgen.h"
+#include "netio.h"
+#include "ordering.h"
+#include "spatial.h"
+#include "telemetry.h"
+#include "threadpool.h"
+
+// side x side grid of 100 m spacing, every node draws 0.5 and node 1 supplies them
+static netdata grid(int side)
+{
+	netdata d;
+	int n = side * side;
+	d.n_nodes = n;
+	for (int i = 0; i < n; i++)
+	{
+		d.x.push_back((i % side) * 100.0);
+		d.y.push_back((i / side) * 100.0);
+		d.Q.push_back(i == 0 ? -(n - 1) * 0.5 : 0.5);
+		if (i % side + 1 < side) { d.n1.push_back(i); d.n2.push_back(i + 1); }
+		if (i / side + 1 < side) { d.n1.push_back(i); d.n2.push_back(i + side); }
+	}
+	d.n_tubes = (int)d.n1.size();
+	for (int t = 0; t < d.n_tubes; t++) d.dia.push_back(0.2 + 0.01 * (t % 7));
+	return d;
+}
+
+static double maxdiff(const std::vector<double>& a, const std::vector<double>& b)
+{
+	double m = 0.0;
+	for (size_t i = 0; i < a.size(); i++) m = std::max(m, std::fabs(a[i] - b[i]));
+	return m;
+}
+
+TEST(PipeNetTest, ReferenceFlows)
+{
+	netdata d;
+	std::string err;
+	ASSERT_TRUE(readnetwork(PIPEDATA, d, err)) << err;
+	pipenet net(d);
+	net.solve();
+	const double expected[11] = {30.6377, 36.5446, 19.3623, 31.1808, 7.58888, 51.6819,
+		36.5446, -11.8184, 38.1816, 23.5919, 61.7734};
+	for (int t = 0; t < 11; t++)
+		EXPECT_NEAR(net.getcore().q[t], expected[t], 1e-3) << "tube " << t + 1;
+}
+
+TEST(PipeNetTest, ParseErrorNamesTheLine)
+{
+	const char text[] = "2\n1\n0 0 -1\n10 0 1\n1 3 0.5\n";
+	netdata d;
+	std::string err;
+	EXPECT_FALSE(parsenetwork(text, text + sizeof(text) - 1, "bad.txt", d, err));
+	EXPECT_NE(err.find("bad.txt:5"), std::string::npos) << err;
+
+	// counts far beyond the file size fail before anything is allocated for them
+	const char huge[] = "2000000000\n2000000000\n0 0 -1\n";
+	EXPECT_FALSE(parsenetwork(huge, huge + sizeof(huge) - 1, "huge.txt", d, err));
+	EXPECT_NE(err.find("huge.txt:2: file is too short"), std::string::npos) << err;
+
+	// the stream constructor takes the same checks and throws with the line
+	std::string name = ::testing::TempDir() + "pipenet_badstream.txt";
+	FILE* f = fopen(name.c_str(), "wb");
+	ASSERT_NE(f, nullptr);
+	fputs(text, f);
+	fclose(f);
+	std::ifstream in(name.c_str());
+	try
+	{
+		pipenet p(in);
+		ADD_FAILURE() << "tube to a missing node was accepted";
+	}
+	catch (const MatVecError& e)
+	{
+		EXPECT_NE(std::string(e.what()).find("input:5"), std::string::npos) << e.what();
+	}
+	remove(name.c_str());
+
+	d.n1[0] = 7;
+	EXPECT_THROW(pipenet p(d), MatVecError);
+}
+
+TEST(PipeNetTest, DirectSolveMatchesCG)
+{
+	netdata d = grid(30);
+	pipenet cg(d), direct(d);
+	cg.setsolver(2, 1e-13, 0);
+	cg.solve();
+	direct.factorize();
+	direct.solve();
+	EXPECT_LT(maxdiff(cg.getcore().head, direct.getcore().head), 1e-8);
+	EXPECT_LT(direct.getresidual(), 1e-10);
+}
+
+TEST(PipeNetTest, OrderingsGiveTheSameHeads)
+{
+	netdata d = grid(25);
+	std::vector<double> ref;
+	for (int method : {ORDER_NATURAL, ORDER_RCM, ORDER_AMD})
+	{
+		pipenet net(d);
+		net.setordering(method);
+		net.factorize();
+		net.solve();
+		if (ref.empty()) ref = net.getcore().head;
+		else EXPECT_LT(maxdiff(ref, net.getcore().head), 1e-9) << "ordering " << method;
+	}
+}
+
+TEST(PipeNetTest, SubdomainsMatchSingleFactorization)
+{
+	netdata d = grid(30);
+	pipenet one(d), parts(d);
+	one.factorize();
+	one.solve();
+	parts.setsubdomains(6);
+	parts.factorize();
+	parts.solve();
+	EXPECT_LT(maxdiff(one.getcore().head, parts.getcore().head), 1e-9);
+}
+
+TEST(PipeNetTest, TubeEditsMatchRefactorization)
+{
+	netdata d = grid(20);
+	pipenet updated(d), fresh(d);
+	updated.factorize();
+	updated.solve();
+	for (pipenet* p : {&updated, &fresh})
+	{
+		p->settubediameter(10, 0.05);
+		p->removetube(31);
+		p->addtube(0, 399, 0.3);
+	}
+	updated.solve();
+	fresh.factorize();
+	fresh.solve();
+	EXPECT_LT(maxdiff(updated.getcore().head, fresh.getcore().head), 1e-9);
+	EXPECT_EQ(updated.getcore().q[31], 0.0);
+
+	// bad edits are refused before anything changes
+	const int tubes = updated.getcore().n_tubes;
+	EXPECT_THROW(updated.settubediameter(tubes, 0.2), MatVecError);
+	EXPECT_THROW(updated.settubediameter(-1, 0.2), MatVecError);
+	EXPECT_THROW(updated.settubediameter(10, 0.0), MatVecError);
+	EXPECT_THROW(updated.settubediameter(10, -0.1), MatVecError);
+	EXPECT_THROW(updated.removetube(tubes), MatVecError);
+	EXPECT_THROW(updated.addtube(0, 400, 0.3), MatVecError);
+	EXPECT_THROW(updated.addtube(-1, 5, 0.3), MatVecError);
+	EXPECT_THROW(updated.addtube(5, 5, 0.3), MatVecError);
+	EXPECT_THROW(updated.addtube(0, 1, 0.0), MatVecError);
+	EXPECT_EQ(updated.getcore().n_tubes, tubes);
+	EXPECT_EQ(updated.getcore().dia[10], 0.05);
+	updated.solve();
+	EXPECT_LT(maxdiff(updated.getcore().head, fresh.getcore().head), 1e-9);
+}
+
+TEST(PipeNetTest, FloatingIslandGetsReferenceHead)
+{
+	netdata d = grid(5);
+	int off = d.n_nodes; //a detached 2 node island
+	d.x.push_back(1000); d.y.push_back(0); d.Q.push_back(-1);
+	d.x.push_back(1100); d.y.push_back(0); d.Q.push_back(1);
+	d.n_nodes += 2;
+	d.n1.push_back(off); d.n2.push_back(off + 1); d.dia.push_back(0.5);
+	d.n_tubes++;
+	pipenet net(d);
+	net.factorize();
+	net.solve();
+	EXPECT_EQ(net.getcomponents(), 2);
+	ASSERT_EQ(net.getislands().size(), 1u);
+	EXPECT_EQ(net.getislands()[0], off);
+	EXPECT_NEAR(net.getcore().q[d.n_tubes - 1], 1.0, 1e-9); //supply at the first node
+}
+
+TEST(PipeNetTest, MixedPrecisionRefinesToTolerance)
+{
+	netdata d = grid(30);
+	pipenet dbl(d), mixed(d);
+	dbl.factorize();
+	dbl.solve();
+	mixed.setsolver(2, 1e-12, 0);
+	mixed.setmixedprecision(true);
+	mixed.factorize();
+	mixed.solve();
+	EXPECT_LT(mixed.getresidual(), 1e-12);
+	EXPECT_LT(maxdiff(dbl.getcore().q, mixed.getcore().q), 1e-8);
+}
+
+TEST(PipeNetTest, ScenarioBlocksMatchSingleSolves)
+{
+	// 21 demand vectors: one full block of 16 and a partial one of 5
+	netdata d = grid(12);
+	const int n = d.n_nodes, nrhs = 21;
+	std::vector<double> Q((size_t)n * nrhs), H((size_t)n * nrhs);
+	for (int r = 0; r < nrhs; r++)
+		for (int i = 0; i < n; i++)
+			Q[(size_t)r * n + i] = (i == 0) ? -(n - 1) * 0.1 * (r + 1) : 0.1 * (r + 1) * (1 + (i * 7 + r) % 5);
+	pipenet block(d), single(d);
+	block.solvescenarios(nrhs, Q.data(), H.data());
+	ASSERT_EQ(block.getstatus(), SOLVE_OK) << block.getmessage();
+	single.factorize();
+	for (int r = 0; r < nrhs; r++)
+	{
+		single.setdemands(&Q[(size_t)r * n]);
+		single.solve();
+		std::vector<double> h(H.begin() + (size_t)r * n, H.begin() + (size_t)(r + 1) * n);
+		EXPECT_LT(maxdiff(h, single.getcore().head), 1e-9) << "scenario " << r;
+	}
+}
+
+TEST(PipeNetTest, ExtendedPeriodScalesDemandsAndMovesTanks)
+{
+	// reservoir - junction - tank in a line, and a second tank above the reservoir: the
+	// junction's demand follows the pattern, the first tank fills until it is full and the
+	// second drains until it is empty
+	netdata d;
+	d.n_nodes = 4;
+	d.x = {0.0, 1000.0, 2000.0, 0.0};
+	d.y = {0.0, 0.0, 0.0, 1000.0};
+	d.Q = {0.0, 0.02, 0.0, 0.0};
+	d.n_tubes = 3;
+	d.n1 = {0, 1, 0};
+	d.n2 = {1, 2, 3};
+	d.dia = {0.1, 0.1, 0.1};
+	pipenet net(d);
+	net.setfixedhead(0, 50.0);
+	const double dt = 60.0, area = 10.0, maxlevel = 6.0, minlevel = 1.5;
+	const double factors[2] = {1.0, 3.0};
+	EXPECT_THROW(extperiod(net, 0.0, 120.0), MatVecError);
+	extperiod eps(net, dt, 2 * dt);
+	int p = eps.addpattern(std::vector<double>(factors, factors + 2));
+	EXPECT_THROW(eps.setpattern(1, p + 1), MatVecError);
+	EXPECT_THROW(eps.setpattern(4, p), MatVecError);
+	eps.setpattern(1, p);
+	eps.addtank(2, 40.0, 5.0, area, 0.0, maxlevel);
+	eps.addtank(3, 52.0, 3.0, area, minlevel, 10.0);
+	const std::string name = ::testing::TempDir() + "pipenet_eps.bin";
+	std::string err;
+	ASSERT_TRUE(eps.run(9 * dt, name.c_str(), err)) << err;
+
+	std::ifstream in(name.c_str(), std::ios::binary);
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	epsheader h;
+	ASSERT_GE(bytes.size(), sizeof(h));
+	memcpy(&h, bytes.data(), sizeof(h));
+	EXPECT_EQ(memcmp(h.magic, EPS_MAGIC, sizeof(EPS_MAGIC)), 0);
+	EXPECT_EQ(h.version, EPS_VERSION);
+	EXPECT_EQ(h.n_nodes, 4);
+	EXPECT_EQ(h.n_tubes, 3);
+	EXPECT_EQ(h.n_tanks, 2);
+	ASSERT_EQ(h.n_steps, 10);
+	EXPECT_EQ(h.dt, dt);
+	const size_t len = 1 + 4 + 3 + 2; //time, heads, flows, tank levels
+	ASSERT_EQ(bytes.size(), sizeof(h) + h.n_steps * len * sizeof(double));
+	std::vector<double> rec(h.n_steps * len);
+	memcpy(rec.data(), bytes.data() + sizeof(h), rec.size() * sizeof(double));
+
+	bool full = false, empty = false;
+	for (int s = 0; s < h.n_steps; s++)
+	{
+		const double* r = &rec[s * len];
+		EXPECT_EQ(r[0], s * dt);
+		EXPECT_NEAR(r[5] - r[6], 0.02 * factors[(s / 2) % 2], 1e-12) << "step " << s; //junction balance
+		EXPECT_NEAR(r[3], 40.0 + r[8], 1e-9) << "step " << s; //tank heads from their levels
+		EXPECT_NEAR(r[4], 52.0 + r[9], 1e-9) << "step " << s;
+		if (s + 1 < h.n_steps)
+		{// level += inflow dt / area, held at the limits
+			double fill = std::min(r[8] + r[6] * dt / area, maxlevel);
+			double drain = std::max(r[9] + r[7] * dt / area, minlevel);
+			EXPECT_NEAR(rec[(s + 1) * len + 8], fill, 1e-12) << "step " << s;
+			EXPECT_NEAR(rec[(s + 1) * len + 9], drain, 1e-12) << "step " << s;
+			full = full || fill == maxlevel;
+			empty = empty || drain == minlevel;
+		}
+	}
+	EXPECT_TRUE(full);
+	EXPECT_TRUE(empty);
+	EXPECT_EQ(eps.gettanklevel(0), maxlevel);
+	EXPECT_EQ(eps.gettanklevel(1), minlevel);
+}
+
+TEST(PipeNetTest, ExtendedPeriodStopsAtAFailedStep)
+{
+	// Newton gets too few iterations for the jump in demand at the third step: run stops
+	// there, the file keeps the two good steps and the tank is not moved by the bad one
+	netdata d;
+	d.n_nodes = 3;
+	d.x = {0.0, 1000.0, 2000.0};
+	d.y = {0.0, 0.0, 0.0};
+	d.Q = {0.0, 0.02, 0.0};
+	d.n_tubes = 2;
+	d.n1 = {0, 1};
+	d.n2 = {1, 2};
+	d.dia = {0.3, 0.3};
+	pipenet net(d);
+	net.setfixedhead(0, 50.0);
+	net.setheadloss(HAZEN_WILLIAMS, 120.0);
+	net.setnewton(1e-8, 1e-8, 5);
+	const double dt = 60.0;
+	const double factors[3] = {1.0, 1.0, 50.0};
+	extperiod eps(net, dt, dt);
+	eps.setpattern(1, eps.addpattern(std::vector<double>(factors, factors + 3)));
+	eps.addtank(2, 40.0, 5.0, 1000.0, 0.0, 10.0);
+	const std::string name = ::testing::TempDir() + "pipenet_eps_failed.bin";
+	std::string err;
+	ASSERT_FALSE(eps.run(5 * dt, name.c_str(), err));
+	EXPECT_NE(err.find("step at t = 120 s: Newton did not converge"), std::string::npos) << err;
+
+	std::ifstream in(name.c_str(), std::ios::binary);
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	const size_t len = 1 + 3 + 2 + 1; //time, heads, flows, tank level
+	ASSERT_EQ(bytes.size(), sizeof(epsheader) + 2 * len * sizeof(double));
+	std::vector<double> rec(2 * len);
+	memcpy(rec.data(), bytes.data() + sizeof(epsheader), rec.size() * sizeof(double));
+	EXPECT_EQ(rec[len], dt);
+	// the tank moved with the second step's inflow and not with the failed third
+	EXPECT_NEAR(eps.gettanklevel(0), rec[len + 6] + rec[len + 5] * dt / 1000.0, 1e-12);
+}
+
+TEST(PipeNetTest, ContingencyMatchesClosedTube)
+{
+	netdata d = grid(10);
+	pipenet base(d);
+	contingency c(base, -1e9);
+	c.addoutage(std::vector<int>(1, 7));
+	std::vector<outageresult> results;
+	std::string err;
+	ASSERT_TRUE(c.run(results, err)) << err;
+	pipenet closed(d);
+	closed.removetube(7);
+	closed.factorize();
+	closed.solve();
+	double lowest = 1e300;
+	for (int i = 1; i < d.n_nodes; i++) lowest = std::min(lowest, closed.getcore().head[i]);
+	ASSERT_TRUE(results[0].connected);
+	EXPECT_NEAR(results[0].minhead, lowest, 1e-9);
+}
+
+TEST(PipeNetTest, TelemetryTimesPhasesAndEstimatesCondition)
+{
+	netdata d = grid(6);
+	solvestats stats;
+	pipenet net(d, &stats);
+	net.factorize();
+	net.solve();
+	EXPECT_EQ(stats.calls[PHASE_GEOMETRY], 1);
+	EXPECT_EQ(stats.calls[PHASE_ORDERING], 1);
+	EXPECT_EQ(stats.calls[PHASE_FACTOR], 1);
+	EXPECT_EQ(stats.calls[PHASE_SOLVE], 1);
+	EXPECT_EQ(stats.solves, 1);
+	EXPECT_EQ(stats.residual, net.getresidual());
+	EXPECT_GT(stats.factorentries, 0);
+
+	// exact ||A||_1 ||A^-1||_1 from the dense inverse, column by column
+	SparseMtx A = net.assemble();
+	const int n = A.size();
+	Mtx dense(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) dense[i][j] = A(i, j);
+	LUMtx lu(dense);
+	double inverse = 0.0;
+	for (int j = 0; j < n; j++)
+	{
+		Vcr e(n);
+		e[j] = 1.0;
+		lu.solve(e);
+		inverse = std::max(inverse, e.onenorm());
+	}
+	double exact = dense.onenorm() * inverse;
+	EXPECT_LE(stats.condition, exact * (1 + 1e-9)); //the estimate is a lower bound
+	EXPECT_GE(stats.condition, 0.3 * exact);
+	EXPECT_NE(stats.json().find("\"condition_estimate\""), std::string::npos);
+}
+
+TEST(PipeNetTest, ResultsFilesHoldTheSolution)
+{
+	netdata d = grid(8);
+	pipenet net(d);
+	std::string err;
+	const std::string base = ::testing::TempDir() + "pipenet_results";
+	ASSERT_TRUE(net.saveresults((base + ".bin").c_str(), err)) << err;
+	ASSERT_TRUE(net.savecsv((base + "_nodes.csv").c_str(), (base + "_tubes.csv").c_str(), err)) << err;
+	const netcore& c = net.getcore();
+
+	netresults r((base + ".bin").c_str());
+	ASSERT_TRUE(r.isvalid()) << r.error();
+	ASSERT_EQ(r.nodes(), d.n_nodes);
+	ASSERT_EQ(r.tubes(), d.n_tubes);
+	for (int i = 0; i < d.n_nodes; i++) EXPECT_EQ(r.head()[i], c.head[i]);
+	for (int t = 0; t < d.n_tubes; t++)
+	{
+		EXPECT_EQ(r.q()[t], c.q[t]);
+		EXPECT_EQ(r.n2()[t], c.n2[t]);
+	}
+
+	// the CSV numbers read back to the same doubles
+	std::ifstream tubes((base + "_tubes.csv").c_str());
+	std::string line;
+	std::getline(tubes, line);
+	EXPECT_EQ(line, "tube,node1,node2,flow");
+	int rows = 0;
+	while (std::getline(tubes, line))
+	{
+		int t, a, b;
+		char flow[64];
+		ASSERT_EQ(sscanf(line.c_str(), "%d,%d,%d,%63s", &t, &a, &b, flow), 4) << line;
+		EXPECT_EQ(a, c.n1[t - 1] + 1);
+		EXPECT_EQ(strtod(flow, NULL), c.q[t - 1]);
+		rows++;
+	}
+	EXPECT_EQ(rows, d.n_tubes);
+
+	// unconverged heads are not results: the files are refused with the solver's message
+	pipenet slow(d);
+	slow.setsolver(0, 1e-12, 2);
+	slow.solve();
+	ASSERT_EQ(slow.getstatus(), SOLVE_NOT_CONVERGED);
+	EXPECT_FALSE(slow.saveresults((base + "_slow.bin").c_str(), err));
+	EXPECT_NE(err.find("CG did not converge"), std::string::npos) << err;
+	EXPECT_FALSE(slow.savecsv((base + "_slow.csv").c_str(), NULL, err));
+	EXPECT_NE(err.find("CG did not converge"), std::string::npos) << err;
+}
+
+TEST(PipeNetTest, SnapshotsRoundTripAndRejectDamagedFiles)
+{
+	netdata d = grid(8);
+	pipenet net(d);
+	net.solve();
+	const netcore& c = net.getcore();
+	std::string err;
+	const std::string base = ::testing::TempDir() + "pipenet_snapshot";
+	ASSERT_TRUE(net.savesnapshot((base + "_heads.bin").c_str(), true, err)) << err;
+	ASSERT_TRUE(net.savesnapshot((base + ".bin").c_str(), false, err)) << err;
+
+	{// stored heads come back bit for bit, with the flows from them
+		netsnapshot snap((base + "_heads.bin").c_str());
+		ASSERT_TRUE(snap.isvalid()) << snap.error();
+		EXPECT_TRUE(snap.hasheads());
+		pipenet loaded(snap);
+		const netcore& l = loaded.getcore();
+		ASSERT_EQ(l.n_nodes, c.n_nodes);
+		for (int i = 0; i < c.n_nodes; i++) EXPECT_EQ(l.head[i], c.head[i]);
+		for (int t = 0; t < c.n_tubes; t++) EXPECT_EQ(l.q[t], c.q[t]);
+	}
+	{// without them the loaded network solves to the same heads
+		netsnapshot snap((base + ".bin").c_str());
+		ASSERT_TRUE(snap.isvalid()) << snap.error();
+		EXPECT_FALSE(snap.hasheads());
+		EXPECT_EQ(snap.head(), (const double*)NULL);
+		pipenet loaded(snap);
+		loaded.solve();
+		EXPECT_LT(maxdiff(loaded.getcore().head, c.head), 1e-9);
+		EXPECT_LT(maxdiff(loaded.getcore().q, c.q), 1e-9);
+	}
+
+	std::ifstream in((base + ".bin").c_str(), std::ios::binary);
+	std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	auto damaged = [&](const std::string& contents, const char* expected) {
+		const std::string name = base + "_damaged.bin";
+		std::ofstream(name.c_str(), std::ios::binary) << contents;
+		netsnapshot snap(name.c_str());
+		EXPECT_FALSE(snap.isvalid());
+		EXPECT_NE(snap.error().find(expected), std::string::npos) << snap.error();
+		EXPECT_THROW(pipenet p(snap), MatVecError);
+	};
+	damaged(bytes.substr(0, bytes.size() - 8), "truncated");
+	std::string magic = bytes;
+	magic[0] = 'X';
+	damaged(magic, "not a pipe network snapshot");
+	std::string version = bytes;
+	version[sizeof(SNAPSHOT_MAGIC)] = (char)(SNAPSHOT_VERSION + 1); //little endian low byte
+	damaged(version, "snapshot version");
+}
+
+TEST(PipeNetTest, VectorExpressionsMovesAndFloatMatrices)
+{
+	const int n = 5;
+	double* raw = new double[n];
+	for (int i = 0; i < n; i++) raw[i] = i + 1.0;
+	Vcr x(n, raw, ADOPT), y(n, 2.0);
+	y += 0.5 * x; //axpy, no temporary vector
+	EXPECT_EQ(y[4], 4.5);
+	Vcr z = x - 2.0 * y;
+	EXPECT_EQ(z[0], 1.0 - 2.0 * 2.5);
+	EXPECT_EQ(dot(x, y - x), dot(x, y) - dot(x, x));
+	EXPECT_DOUBLE_EQ(twonorm(x + y), Vcr(x + y).twonorm());
+
+	Vcr moved(std::move(x));
+	EXPECT_EQ(x.size(), 0);
+	EXPECT_EQ(moved[2], 3.0);
+	double* back = moved.release();
+	EXPECT_EQ(back, raw);
+	delete[] back;
+
+	Mtxf A(3, 0.0f); //diagonally dominant, solved in single precision
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++) A[i][j] = (i == j) ? 4.0f : 1.0f;
+	Vcrf b(3, 6.0f);
+	std::move(A).GaussElim(b); //factored in place
+	for (int i = 0; i < 3; i++) EXPECT_NEAR(b[i], 1.0f, 1e-6f);
+}
+
+TEST(PipeNetTest, BlockedLUPivotsAcrossPanels)
+{
+	// several panels and row tiles of the blocked factorization; the diagonal is zero, so
+	// every column needs a row swap
+	const int n = 300;
+	Mtx A(n);
+	unsigned long long s = 12345;
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+		{
+			s = s * 6364136223846793005ULL + 1442695040888963407ULL;
+			A[i][j] = (i == j) ? 0.0 : (double)(s >> 11) / 9007199254740992.0 - 0.5;
+		}
+	auto times = [&](const Vcr& v) { //dense A v
+		Vcr w(n);
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < n; j++) w[i] += A[i][j] * v[j];
+		return w;
+	};
+	Vcr x(n);
+	for (int i = 0; i < n; i++) x[i] = 1.0 + (i % 5);
+	Vcr b = times(x);
+
+	LUMtx lu(A);
+	ASSERT_EQ(lu.info(), 0);
+	Vcr y = b;
+	lu.solve(y);
+	Vcr z = b;
+	A.GaussElim(z);
+	Vcr r = times(y) - b;
+	EXPECT_LT(r.maxnorm(), 1e-13 * A.maxnorm() * n * y.maxnorm());
+	for (int i = 0; i < n; i++)
+	{
+		EXPECT_NEAR(y[i], x[i], 1e-8);
+		EXPECT_EQ(z[i], y[i]); //the same factorization either way
+	}
+
+	Mtx S(n); //rank one, exactly singular at the second column
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) S[i][j] = 1.0;
+	LUMtx slu(S);
+	EXPECT_EQ(slu.info(), 2);
+}
+
+TEST(PipeNetTest, MultigridMatchesDirectSolveAfterTubeEdits)
+{
+	netdata d = grid(60);
+	pipenet direct(d), amg(d);
+	amg.setsolver(3, 1e-12, 0);
+	direct.factorize();
+	for (int pass = 0; pass < 2; pass++)
+	{
+		direct.solve();
+		amg.solve(); //the second pass refreshes the kept levels
+		EXPECT_LT(amg.getresidual(), 1e-12);
+		EXPECT_LT(amg.getiterations(), 60);
+		EXPECT_LT(maxdiff(direct.getcore().head, amg.getcore().head), 1e-7);
+		direct.settubediameter(100, 0.05);
+		amg.settubediameter(100, 0.05);
+	}
+}
+
+TEST(PipeNetTest, GeneratedNetworksAreConnectedBalancedAndReproducible)
+{
+	const nettopology kinds[4] = {NET_GRID, NET_GEOMETRIC, NET_TREE, NET_ISLANDS};
+	for (nettopology kind : kinds)
+	{
+		netgenoptions opt;
+		opt.topology = kind;
+		opt.nodes = 3000;
+		opt.islands = 3;
+		opt.seed = 11;
+		netdata d, again, other;
+		std::string err;
+		ASSERT_TRUE(generatenetwork(opt, d, err)) << err;
+		ASSERT_TRUE(generatenetwork(opt, again, err)) << err;
+		opt.seed = 12;
+		ASSERT_TRUE(generatenetwork(opt, other, err)) << err;
+		ASSERT_EQ(d.n_nodes, 3000);
+		EXPECT_EQ(d.x, again.x);
+		EXPECT_EQ(d.n2, again.n2);
+		EXPECT_EQ(d.Q, again.Q);
+		EXPECT_NE(d.Q, other.Q);
+
+		double sum = 0.0; //exact, the demands are multiples of 1/1024
+		for (double q : d.Q) sum += q;
+		EXPECT_EQ(sum, 0.0);
+		for (int t = 0; t < d.n_tubes; t++)
+			EXPECT_GE(std::hypot(d.x[d.n1[t]] - d.x[d.n2[t]], d.y[d.n1[t]] - d.y[d.n2[t]]), 0.25 * opt.spacing);
+
+		// the file reads back to the same network, and every part is connected
+		const std::string file = ::testing::TempDir() + "pipenet_generated.txt";
+		ASSERT_TRUE(writenetwork(file.c_str(), d, err)) << err;
+		ASSERT_TRUE(readnetwork(file.c_str(), again, err)) << err;
+		EXPECT_EQ(d.y, again.y);
+		EXPECT_EQ(d.Q, again.Q);
+		EXPECT_EQ(d.n1, again.n1);
+		EXPECT_EQ(d.dia, again.dia);
+		pipenet net(d);
+		net.solve();
+		EXPECT_EQ(net.getcomponents(), kind == NET_ISLANDS ? 3 : 1);
+	}
+	netgenoptions bad;
+	bad.nodes = 0;
+	netdata d;
+	std::string err;
+	EXPECT_FALSE(generatenetwork(bad, d, err));
+	EXPECT_FALSE(err.empty());
+}
+
+TEST(PipeNetTest, SpatialIndexMatchesBruteForce)
+{
+	netgenoptions opt;
+	opt.topology = NET_GEOMETRIC;
+	opt.nodes = 5000;
+	opt.seed = 5;
+	netdata d;
+	std::string err;
+	ASSERT_TRUE(generatenetwork(opt, d, err)) << err;
+	spatialindex index(d);
+	ASSERT_EQ(index.nodes(), d.n_nodes);
+	ASSERT_EQ(index.tubes(), d.n_tubes);
+
+	for (int probe = 0; probe < 50; probe++)
+	{
+		double x = std::fmod(71.3 * probe * 13, 7100.0), y = std::fmod(97.1 * probe * 7, 7100.0);
+		std::vector<double> nd(d.n_nodes), td(d.n_tubes);
+		for (int i = 0; i < d.n_nodes; i++) nd[i] = std::hypot(d.x[i] - x, d.y[i] - y);
+		for (int t = 0; t < d.n_tubes; t++)
+		{
+			double ax = d.x[d.n1[t]], ay = d.y[d.n1[t]], bx = d.x[d.n2[t]], by = d.y[d.n2[t]];
+			double u = ((x - ax) * (bx - ax) + (y - ay) * (by - ay)) / ((bx - ax) * (bx - ax) + (by - ay) * (by - ay));
+			u = std::min(std::max(u, 0.0), 1.0);
+			td[t] = std::hypot(ax + u * (bx - ax) - x, ay + u * (by - ay) - y);
+		}
+		int nodes[5], tubes[5];
+		double ndist[5], tdist[5];
+		ASSERT_EQ(index.nearestnodes(x, y, 5, nodes, ndist), 5);
+		ASSERT_EQ(index.nearesttubes(x, y, 5, tubes, tdist), 5);
+		std::sort(nd.begin(), nd.end());
+		std::sort(td.begin(), td.end());
+		for (int k = 0; k < 5; k++)
+		{
+			EXPECT_NEAR(ndist[k], nd[k], 1e-9);
+			EXPECT_NEAR(std::hypot(d.x[nodes[k]] - x, d.y[nodes[k]] - y), ndist[k], 1e-9);
+			EXPECT_NEAR(tdist[k], td[k], 1e-9);
+		}
+
+		// a box, and the same square as a polygon
+		double x0 = x - 250.005, y0 = y - 150.005, x1 = x + 250.005, y1 = y + 150.005;
+		std::vector<int> inbox, inpoly, expected;
+		for (int i = 0; i < d.n_nodes; i++)
+			if (d.x[i] >= x0 && d.x[i] <= x1 && d.y[i] >= y0 && d.y[i] <= y1) expected.push_back(i);
+		index.nodesinbox(x0, y0, x1, y1, inbox);
+		const double px[4] = {x0, x1, x1, x0}, py[4] = {y0, y0, y1, y1};
+		index.nodesinpolygon(4, px, py, inpoly);
+		EXPECT_EQ(inbox, expected);
+		EXPECT_EQ(inpoly, expected);
+	}
+
+	// a tube across a box with both ends outside it, and one whose bounding box overlaps
+	// the box but which passes beside it
+	const double x[4] = {0, 10, 0, 10}, y[4] = {5, 5, 12, 22};
+	const int n1[2] = {0, 2}, n2[2] = {1, 3};
+	spatialindex small(4, x, y, 2, n1, n2);
+	std::vector<int> found;
+	small.tubesinbox(4, 4, 6, 15, found);
+	ASSERT_EQ(found.size(), 1u);
+	EXPECT_EQ(found[0], 0);
+	int t[3];
+	double dist[3];
+	ASSERT_EQ(small.nearesttubes(5, 0, 3, t, dist), 2); //fewer tubes than asked for
+	EXPECT_EQ(t[0], 0);
+	EXPECT_EQ(dist[0], 5.0);
+}
+
+TEST(PipeNetTest, AdjointGradientMatchesFiniteDifferences)
+{
+	netdata d = grid(8);
+	pipenet net(d);
+	net.factorize();
+	net.settubediameter(5, 0.35); //the gradient goes through the low-rank update as well
+	d.dia[5] = 0.35;
+	net.removetube(20); //closed: no gradient, and none of the others goes through it
+	std::vector<double> g(d.n_tubes), mean(d.n_tubes), w(d.n_nodes, 1.0 / d.n_nodes);
+	int node;
+	std::string err;
+	ASSERT_TRUE(net.minheadgradient(g.data(), node, err)) << err;
+	ASSERT_TRUE(net.headgradient(w.data(), mean.data(), err)) << err;
+	ASSERT_GT(node, 0);
+
+	// central differences, one pair of full solves per tube
+	auto heads = [&](int t, double dia) {
+		netdata e = d;
+		e.dia[t] = dia;
+		pipenet p(e);
+		p.removetube(20);
+		p.factorize();
+		p.solve();
+		return p.getcore().head;
+	};
+	const int tubes[6] = {0, 5, 13, 20, 60, 111};
+	for (int t : tubes)
+	{
+		double step = 1e-4 * d.dia[t]; //truncation error well below the tolerance, rounding too
+		std::vector<double> hp = heads(t, d.dia[t] + step), hm = heads(t, d.dia[t] - step);
+		double fd = (hp[node] - hm[node]) / (2 * step), fdmean = 0.0;
+		for (int i = 0; i < d.n_nodes; i++) fdmean += w[i] * (hp[i] - hm[i]) / (2 * step);
+		EXPECT_NEAR(g[t], fd, 1e-6 * std::fabs(fd) + 1e-9) << "tube " << t;
+		EXPECT_NEAR(mean[t], fdmean, 1e-6 * std::fabs(fdmean) + 1e-9) << "tube " << t;
+	}
+	EXPECT_EQ(g[20], 0.0);
+	EXPECT_EQ(mean[20], 0.0);
+
+	net.setheadloss(HAZEN_WILLIAMS, 130.0);
+	EXPECT_FALSE(net.headgradient(w.data(), g.data(), err));
+}
+
+TEST(PipeNetTest, NewtonMatchesHandComputedHeadLosses)
+{
+	// a reservoir at node 1 feeding node 2 through two parallel tubes and node 3 from
+	// node 2 through a third; the flows are known, so the head losses follow from the laws
+	netdata d;
+	d.n_nodes = 3;
+	d.x = {0.0, 1000.0, 1000.0};
+	d.y = {0.0, 0.0, 800.0};
+	d.Q = {-0.07, 0.04, 0.03};
+	d.n_tubes = 3;
+	d.n1 = {0, 0, 1};
+	d.n2 = {1, 1, 2};
+	d.dia = {0.3, 0.2, 0.25};
+	const double qin = 0.07, qout = 0.03;
+
+	// Hazen-Williams in closed form: q = K dh^(1/1.852) for every tube
+	const double C = 120.0, e = 1.0 / 1.852;
+	auto K = [&](double dia, double length) { return C * std::pow(std::pow(dia, 4.87) / (10.67 * length), e); };
+	double dh12 = std::pow(qin / (K(0.3, 1000.0) + K(0.2, 1000.0)), 1.852);
+	double dh23 = std::pow(qout / K(0.25, 800.0), 1.852);
+	pipenet hw(d);
+	hw.setfixedhead(0, 100.0);
+	hw.setheadloss(HAZEN_WILLIAMS, C);
+	hw.solve();
+	ASSERT_EQ(hw.getstatus(), SOLVE_OK) << hw.getmessage();
+	EXPECT_NEAR(hw.getcore().head[1], 100.0 - dh12, 1e-7);
+	EXPECT_NEAR(hw.getcore().head[2], 100.0 - dh12 - dh23, 1e-7);
+	EXPECT_NEAR(hw.getcore().q[0] + hw.getcore().q[1], qin, 1e-9);
+
+	// Darcy-Weisbach with Swamee-Jain, dh for the given flow by bisection
+	const double eps = 5e-4;
+	auto dwflow = [&](double dh, double dia, double length) {
+		double a = std::sqrt(9.81 * dia * dh / length);
+		return -0.965 * dia * dia * a * std::log(eps / (3.7 * dia) + 1.784e-6 / (dia * a));
+	};
+	auto headloss = [&](double q, const std::vector<double>& dia, double length) {
+		double lo = 0.0, hi = 100.0;
+		for (int k = 0; k < 200; k++)
+		{
+			double mid = 0.5 * (lo + hi), sum = 0.0;
+			for (double D : dia) sum += dwflow(mid, D, length);
+			(sum < q ? lo : hi) = mid;
+		}
+		return 0.5 * (lo + hi);
+	};
+	dh12 = headloss(qin, {0.3, 0.2}, 1000.0);
+	dh23 = headloss(qout, {0.25}, 800.0);
+	pipenet dw(d);
+	dw.setfixedhead(0, 100.0);
+	dw.setheadloss(DARCY_WEISBACH, eps);
+	dw.solve();
+	ASSERT_EQ(dw.getstatus(), SOLVE_OK) << dw.getmessage();
+	EXPECT_NEAR(dw.getcore().head[1], 100.0 - dh12, 1e-7);
+	EXPECT_NEAR(dw.getcore().head[2], 100.0 - dh12 - dh23, 1e-7);
+
+	// one iteration is enough from the converged heads but not from the laminar start
+	dw.setnewton(1e-8, 1e-8, 1);
+	dw.solve();
+	EXPECT_EQ(dw.getstatus(), SOLVE_OK);
+	pipenet cold(d);
+	cold.setfixedhead(0, 100.0);
+	cold.setheadloss(DARCY_WEISBACH, eps);
+	cold.setnewton(1e-8, 1e-8, 1);
+	cold.solve();
+	EXPECT_EQ(cold.getstatus(), SOLVE_NOT_CONVERGED);
+	EXPECT_NE(cold.getmessage().find("Newton did not converge"), std::string::npos);
+	cold.setnewton(1e-8, 1e-8, 50);
+	cold.solve();
+	EXPECT_EQ(cold.getstatus(), SOLVE_OK);
+	EXPECT_NEAR(cold.getcore().head[2], dw.getcore().head[2], 1e-7);
+
+	// scenarios are laminar solves only
+	std::vector<double> H(3);
+	dw.solvescenarios(1, d.Q.data(), H.data());
+	EXPECT_EQ(dw.getstatus(), SOLVE_UNSUPPORTED);
+}
+
+TEST(PipeNetTest, LibraryReportsErrorsAndSolvesConcurrently)
+{
+	EXPECT_THROW(dot(Vcr(2), Vcr(3)), MatVecError);
+	threadpool pool(2);
+	EXPECT_THROW(pool.parallel_for(100, [](int i) { if (i == 57) error("bad index"); }), MatVecError);
+
+	// a failed solve sets the status; the message goes to a log only if one is given, the
+	// library prints nothing of its own
+	netdata d = grid(20);
+	pipenet slow(d);
+	slow.setsolver(0, 1e-12, 3);
+	std::ostringstream out;
+	std::streambuf* console = std::cout.rdbuf(out.rdbuf());
+	slow.solve();
+	std::string flows = slow.calcflowrate();
+	std::cout.rdbuf(console);
+	EXPECT_TRUE(out.str().empty()) << out.str();
+	EXPECT_EQ(slow.getstatus(), SOLVE_NOT_CONVERGED);
+	EXPECT_NE(slow.getmessage().find("CG did not converge"), std::string::npos);
+	EXPECT_NE(flows.find("Tube number--  " + std::to_string(d.n_tubes) + "\t"), std::string::npos);
+	std::ostringstream log;
+	slow.setlog(&log);
+	slow.solve();
+	EXPECT_EQ(log.str(), slow.getmessage() + "\n");
+	slow.setsolver(2, 1e-12, 0);
+	slow.solve();
+	EXPECT_EQ(slow.getstatus(), SOLVE_OK);
+	EXPECT_TRUE(slow.getmessage().empty());
+
+	// independent networks solved from several threads at once, sharing the thread pool
+	pipenet ref(d);
+	ref.factorize();
+	ref.solve();
+	std::vector<double> diff(4, 1.0);
+	std::vector<int> status(4, -1);
+	std::vector<std::thread> threads;
+	for (int k = 0; k < 4; k++)
+		threads.emplace_back([&, k]() {
+			pipenet p(d);
+			p.setsolver(k, 1e-12, 0); //direct for k = 0, then Jacobi, IC and multigrid CG
+			if (k == 0) p.factorize();
+			p.solve();
+			status[k] = p.getstatus();
+			diff[k] = maxdiff(p.getcore().head, ref.getcore().head);
+		});
+	for (std::thread& t : threads) t.join();
+	for (int k = 0; k < 4; k++)
+	{
+		EXPECT_EQ(status[k], SOLVE_OK) << "solver " << k;
+		EXPECT_LT(diff[k], 1e-6) << "solver " << k;
+	}
+}